@@ -64,26 +64,30 @@ int main()
     double b = 1;
     std::string title = "blocks";
     std::string filename = "examples/blocks.svg";
-    quicksvg::graph_fn blck(a, b, title, filename, /* samples = */ 2048);
+    quicksvg::graph_fn blck(a, b, title, filename, /* samples = */ 128);
+    blck.set_adaptive(/* max_evaluations = */ 2048);
     blck.add_fn(blocks<double>);
     blck.write_all();
 
     title = "bumps";
     filename = "examples/bumps.svg";
 
-    quicksvg::graph_fn bmps(a, b, title, filename, 2048);
+    quicksvg::graph_fn bmps(a, b, title, filename, 128);
+    bmps.set_adaptive(2048);
     bmps.add_fn(bumps<double>);
     bmps.write_all();
 
     title = "heavisine";
     filename = "examples/heavisine.svg";
-    quicksvg::graph_fn hsin(a, b, title, filename, 2048);
+    quicksvg::graph_fn hsin(a, b, title, filename, 128);
+    hsin.set_adaptive(2048);
     hsin.add_fn(heavisine<double>);
     hsin.write_all();
 
     title = "doppler";
     filename = "examples/doppler.svg";
-    quicksvg::graph_fn dop(a, b, title, filename, 2048);
+    quicksvg::graph_fn dop(a, b, title, filename, 128);
+    dop.set_adaptive(2048);
     dop.add_fn(doppler<double>);
     dop.write_all();
 }
@@ -0,0 +1,55 @@
+#ifndef QUICKSVG_BINARY_SERIES_HPP
+#define QUICKSVG_BINARY_SERIES_HPP
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+namespace quicksvg {
+
+enum class sample_type { float32, float64 };
+
+inline size_t sample_size(sample_type dtype)
+{
+    return dtype == sample_type::float32 ? 4 : 8;
+}
+
+// Where one series lies in a raw binary file of native-endian samples: count samples of type dtype,
+// the first at byte offset and each later one stride bytes after the last. stride = 0 means packed.
+struct binary_series
+{
+    sample_type dtype;
+    size_t offset;
+    size_t stride;
+    size_t count;
+
+    // Series index of `series` series stored sample by sample, after a header of header bytes.
+    static binary_series interleaved(sample_type dtype, size_t series, size_t index, size_t count, size_t header = 0)
+    {
+        if (index >= series)
+        {
+            throw std::domain_error("Series index " + std::to_string(index) + " is out of range for "
+                                    + std::to_string(series) + " interleaved series.");
+        }
+        return binary_series{dtype, header + index*sample_size(dtype), series*sample_size(dtype), count};
+    }
+
+    // Series index of several stored one after another, each of count samples, after a header of header bytes.
+    static binary_series planar(sample_type dtype, size_t index, size_t count, size_t header = 0)
+    {
+        return binary_series{dtype, header + index*count*sample_size(dtype), sample_size(dtype), count};
+    }
+
+    size_t packed_stride() const
+    {
+        return stride == 0 ? sample_size(dtype) : stride;
+    }
+
+    // The bytes of the file the series needs.
+    size_t extent() const
+    {
+        return count == 0 ? 0 : offset + (count - 1)*packed_stride() + sample_size(dtype);
+    }
+};
+
+} // namespace quicksvg
+#endif
@@ -0,0 +1,37 @@
+#ifndef QUICKSVG_DETAIL_BATCH_HPP
+#define QUICKSVG_DETAIL_BATCH_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace quicksvg { namespace detail {
+
+// add_fn accepts either a scalar callable, y = f(x), or a batch callable, f(x, y, n), which writes y[i] = f(x[i])
+// for i < n. Batch callables are called on chunks of this many points:
+constexpr size_t batch_chunk_size = 1024;
+
+template<class F, class Real, class = void>
+struct is_batch_callable : std::false_type {};
+
+template<class F, class Real>
+struct is_batch_callable<F, Real, std::void_t<decltype(std::declval<F&>()(std::declval<Real const *>(), std::declval<Real*>(), std::declval<size_t>()))>> : std::true_type {};
+
+// A single evaluation through either interface. The scalar result keeps whatever type f returns.
+template<class F, class Real>
+auto evaluate_at(F & f, Real const & x)
+{
+    if constexpr (is_batch_callable<F, Real>::value)
+    {
+        Real y;
+        f(&x, &y, size_t(1));
+        return y;
+    }
+    else
+    {
+        return f(x);
+    }
+}
+
+}}
+#endif
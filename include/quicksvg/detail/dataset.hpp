@@ -0,0 +1,148 @@
+#ifndef QUICKSVG_DETAIL_DATASET_HPP
+#define QUICKSVG_DETAIL_DATASET_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "parallel.hpp"
+
+namespace quicksvg { namespace detail {
+
+// The samples of one dataset, owned, shared with the caller, or merely viewed.
+// Only the first two keep the memory alive; a view relies on the caller to do so until the plot is written.
+template<class T>
+class dataset_view
+{
+public:
+    using value_type = T;
+
+    explicit dataset_view(std::vector<T> && owned) : dataset_view(std::make_shared<std::vector<T> const>(std::move(owned)))
+    {
+    }
+
+    explicit dataset_view(std::shared_ptr<std::vector<T> const> shared) :
+        owner_{shared},
+        data_{shared->data()},
+        size_{shared->size()}
+    {
+    }
+
+    dataset_view(T const * data, size_t size) : data_{data}, size_{size}
+    {
+    }
+
+    T const * begin() const
+    {
+        return data_;
+    }
+
+    T const * end() const
+    {
+        return data_ + size_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    T const & operator[](size_t i) const
+    {
+        return data_[i];
+    }
+
+private:
+    std::shared_ptr<void const> owner_;
+    T const * data_;
+    size_t size_;
+};
+
+// size samples of type T, stride bytes apart, as laid out in a binary file; they need not be aligned.
+// The owner, typically a mapped_file, keeps the bytes alive.
+template<class T>
+class strided_view
+{
+public:
+    using value_type = T;
+
+    strided_view(std::shared_ptr<void const> owner, unsigned char const * data, size_t stride, size_t size) :
+        owner_{std::move(owner)},
+        data_{data},
+        stride_{stride},
+        size_{size}
+    {
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    T operator[](size_t i) const
+    {
+        T x;
+        std::memcpy(&x, data_ + i*stride_, sizeof(T));
+        return x;
+    }
+
+private:
+    std::shared_ptr<void const> owner_;
+    unsigned char const * data_;
+    size_t stride_;
+    size_t size_;
+};
+
+// The smallest and largest samples of a non-empty view, scanned on `threads` threads (0 = every core).
+template<class View>
+std::pair<typename View::value_type, typename View::value_type> parallel_minmax(View const & v, unsigned threads)
+{
+    using T = typename View::value_type;
+    threads = thread_count(v.size(), threads);
+    std::vector<std::pair<T, T>> extremes(threads, std::pair<T, T>(v[0], v[0]));
+    parallel_blocks(v.size(), threads, [&](unsigned t, size_t begin, size_t end)
+    {
+        T lo = extremes[t].first;
+        T hi = extremes[t].second;
+        for (size_t i = begin; i < end; ++i)
+        {
+            T x = v[i];
+            if (x < lo)
+            {
+                lo = x;
+            }
+            if (x > hi)
+            {
+                hi = x;
+            }
+        }
+        extremes[t] = std::pair<T, T>(lo, hi);
+    });
+    std::pair<T, T> result = extremes[0];
+    for (auto const & e : extremes)
+    {
+        if (e.first < result.first)
+        {
+            result.first = e.first;
+        }
+        if (e.second > result.second)
+        {
+            result.second = e.second;
+        }
+    }
+    return result;
+}
+
+}}
+#endif
@@ -0,0 +1,50 @@
+#ifndef QUICKSVG_DETAIL_FLOAT_BITS_HPP
+#define QUICKSVG_DETAIL_FLOAT_BITS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace quicksvg { namespace detail {
+
+template<class Real>
+struct float_bits;
+
+template<>
+struct float_bits<float>
+{
+    using type = uint32_t;
+};
+
+template<>
+struct float_bits<double>
+{
+    using type = uint64_t;
+};
+
+// Maps an IEEE float to an unsigned integer such that x < y if and only if ordered(x) < ordered(y),
+// and consecutive integers are consecutive representable values. -0 and +0 map to adjacent integers.
+template<class Real>
+typename float_bits<Real>::type to_ordered(Real x)
+{
+    using U = typename float_bits<Real>::type;
+    static_assert(sizeof(U) == sizeof(Real), "Unexpected floating point layout");
+    constexpr U sign = U(1) << (8*sizeof(U) - 1);
+    U u;
+    std::memcpy(&u, &x, sizeof(Real));
+    return (u & sign) ? ~u : (u | sign);
+}
+
+template<class Real>
+Real from_ordered(typename float_bits<Real>::type k)
+{
+    using U = typename float_bits<Real>::type;
+    constexpr U sign = U(1) << (8*sizeof(U) - 1);
+    U u = (k & sign) ? (k ^ sign) : ~k;
+    Real x;
+    std::memcpy(&x, &u, sizeof(Real));
+    return x;
+}
+
+}}
+#endif
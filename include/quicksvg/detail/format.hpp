@@ -0,0 +1,124 @@
+#ifndef QUICKSVG_DETAIL_FORMAT_HPP
+#define QUICKSVG_DETAIL_FORMAT_HPP
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ios>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace quicksvg { namespace detail {
+
+// Screen coordinates are written with this many decimals; 2 is 0.01px, far below anything a renderer can show.
+constexpr int default_coordinate_decimals = 2;
+constexpr int max_coordinate_decimals = 9;
+
+inline int checked_coordinate_decimals(int decimals)
+{
+    if (decimals < 0 || decimals > max_coordinate_decimals)
+    {
+        throw std::domain_error("Coordinate decimals must be in [0, " + std::to_string(max_coordinate_decimals)
+                                + "]; requested " + std::to_string(decimals));
+    }
+    return decimals;
+}
+
+// Writes x rounded to `decimals` places, without trailing zeros, to [first, first + 32) and returns the end.
+// Fixed point via integer to_chars: locale-independent, and much faster than operator<< on a double.
+inline char* format_coordinate(char* first, double x, int decimals)
+{
+    static constexpr uint64_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    uint64_t p = powers[decimals];
+    double scaled = x*static_cast<double>(p);
+    if (!(std::abs(scaled) < 9.0e18))
+    {
+        // Absurdly far off screen, or not finite. SVG has no nan or inf, so those become 0 and the largest finite double:
+        if (std::isnan(x))
+        {
+            x = 0;
+        }
+        else if (std::isinf(x))
+        {
+            x = std::copysign(std::numeric_limits<double>::max(), x);
+        }
+        return first + std::snprintf(first, 32, "%.17g", x);
+    }
+    int64_t n = std::llround(scaled);
+    if (n < 0)
+    {
+        *first++ = '-';
+    }
+    uint64_t u = n < 0 ? uint64_t(0) - static_cast<uint64_t>(n) : static_cast<uint64_t>(n);
+    first = std::to_chars(first, first + 20, u/p).ptr;
+    uint64_t fraction = u % p;
+    if (fraction != 0)
+    {
+        int digits = decimals;
+        while (fraction % 10 == 0)
+        {
+            fraction /= 10;
+            --digits;
+        }
+        *first++ = '.';
+        for (int i = digits - 1; i >= 0; --i)
+        {
+            first[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        first += digits;
+    }
+    return first;
+}
+
+// The number of decimals is stream state, like the precision: set it once with os << coordinate_decimals(d),
+// then write each coordinate as os << coordinate(x).
+inline int coordinate_decimals_index()
+{
+    static int const index = std::ios_base::xalloc();
+    return index;
+}
+
+struct coordinate_decimals
+{
+    int decimals;
+};
+
+inline std::ostream& operator<<(std::ostream& os, coordinate_decimals d)
+{
+    // iword is zero-initialized, so store decimals + 1 and read 0 as the default:
+    os.iword(coordinate_decimals_index()) = checked_coordinate_decimals(d.decimals) + 1;
+    return os;
+}
+
+inline int stream_coordinate_decimals(std::ostream& os)
+{
+    long stored = os.iword(coordinate_decimals_index());
+    return stored == 0 ? default_coordinate_decimals : static_cast<int>(stored - 1);
+}
+
+struct screen_coordinate
+{
+    double value;
+};
+
+// Multiprecision types are converted to double once here; a pixel needs nothing more.
+template<class Real>
+screen_coordinate coordinate(Real const & x)
+{
+    return screen_coordinate{static_cast<double>(x)};
+}
+
+inline std::ostream& operator<<(std::ostream& os, screen_coordinate c)
+{
+    char buffer[32];
+    char* end = format_coordinate(buffer, c.value, stream_coordinate_decimals(os));
+    os.write(buffer, end - buffer);
+    return os;
+}
+
+}}
+#endif
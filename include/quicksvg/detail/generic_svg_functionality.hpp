@@ -2,12 +2,14 @@
 #define QUICKSVG_DETAIL_GENERIC_SVG_FUNCTIONALITY
 
 #include <iomanip>
-#include <fstream>
+#include <ostream>
 #include <cmath>
+#include <string>
+#include "format.hpp"
 
 namespace quicksvg { namespace detail {
 
-void write_prelude(std::ofstream& fs, std::string const & title, int width, int height, int margin_top)
+void write_prelude(std::ostream& fs, std::string const & title, int width, int height, int margin_top)
 {
     using std::floor;
     fs << "<?xml version=\"1.0\" encoding='UTF-8' ?>\n"
@@ -28,7 +30,7 @@ void write_prelude(std::ofstream& fs, std::string const & title, int width, int
     }
 }
 
-void write_xlabel(std::ofstream& fs, std::string const & x_label, int width, int height, int margin_bottom)
+void write_xlabel(std::ostream& fs, std::string const & x_label, int width, int height, int margin_bottom)
 {
     using std::floor;
     fs << "<text x='" << floor(width/2)
@@ -38,7 +40,7 @@ void write_xlabel(std::ofstream& fs, std::string const & x_label, int width, int
        << "</text>\n";
 }
 
-void write_ylabel(std::ofstream& fs, std::string const & y_label, int width, int height, int margin_left)
+void write_ylabel(std::ostream& fs, std::string const & y_label, int width, int height, int margin_left)
 {
     using std::floor;
     fs << "<text x='0' y='0' font-family='Palatino' font-size='15' fill='white' alignment-baseline='middle' text-anchor='middle' transform='translate("
@@ -49,7 +51,7 @@ void write_ylabel(std::ofstream& fs, std::string const & y_label, int width, int
 
 
 template<class F1, class F2, class Real>
-void write_gridlines(std::ofstream& fs, int horizontal_lines, int vertical_lines,
+void write_gridlines(std::ostream& fs, int horizontal_lines, int vertical_lines,
                      F1 x_scale, F2 y_scale, Real min_x, Real max_x, Real min_y, Real max_y,
                      int graph_width, int graph_height, int margin_left)
 {
@@ -57,24 +59,24 @@ void write_gridlines(std::ofstream& fs, int horizontal_lines, int vertical_lines
   for (int i = 1; i <= horizontal_lines; ++i) {
       Real y_cord_dataspace = min_y +  ((max_y - min_y)*i)/horizontal_lines;
       auto y = y_scale(y_cord_dataspace);
-      fs << "<line x1='0' y1='" << y << "' x2='" << graph_width
-         << "' y2='" << y
+      fs << "<line x1='0' y1='" << coordinate(y) << "' x2='" << graph_width
+         << "' y2='" << coordinate(y)
          << "' stroke='gray' stroke-width='1' opacity='0.5' stroke-dasharray='4' />\n";
 
-      fs << "<text x='" <<  -margin_left/4 + 5 << "' y='" << y - 3
+      fs << "<text x='" <<  -margin_left/4 + 5 << "' y='" << coordinate(y - 3)
          << "' font-family='times' font-size='10' fill='white' transform='rotate(-90 "
-         << -margin_left/4 + 8 << " " << y + 5 << ")'>"
+         << -margin_left/4 + 8 << " " << coordinate(y + 5) << ")'>"
          << std::setprecision(4) << y_cord_dataspace << "</text>\n";
    }
 
    for (int i = 1; i <= vertical_lines; ++i) {
        Real x_cord_dataspace = min_x +  ((max_x - min_x)*i)/vertical_lines;
        Real x = x_scale(x_cord_dataspace);
-       fs << "<line x1='" << x << "' y1='0' x2='" << x
+       fs << "<line x1='" << coordinate(x) << "' y1='0' x2='" << coordinate(x)
           << "' y2='" << graph_height
           << "' stroke='gray' stroke-width='1' opacity='0.5' stroke-dasharray='4' />\n";
 
-        fs << "<text x='" <<  x - 10  << "' y='" << graph_height + 10
+        fs << "<text x='" <<  coordinate(x - 10)  << "' y='" << graph_height + 10
              << "' font-family='times' font-size='10' fill='white'>"
              << std::setprecision(4) << x_cord_dataspace << "</text>\n";
     }
@@ -0,0 +1,87 @@
+#ifndef QUICKSVG_DETAIL_MAPPED_FILE_HPP
+#define QUICKSVG_DETAIL_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define QUICKSVG_HAS_MMAP
+#endif
+
+namespace quicksvg { namespace detail {
+
+// Read-only view of a whole file. Uses mmap where available, and falls back to reading the file into memory elsewhere.
+// A file which cannot be opened yields an empty mapping rather than an exception; callers decide whether that is an error.
+class mapped_file {
+public:
+    explicit mapped_file(std::string const & filename)
+    {
+#ifdef QUICKSVG_HAS_MMAP
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data_ = static_cast<const unsigned char*>(p);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+        if (!ifs)
+        {
+            return;
+        }
+        buffer_.resize(static_cast<size_t>(ifs.tellg()));
+        ifs.seekg(0);
+        ifs.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#endif
+    }
+
+    mapped_file(mapped_file const &) = delete;
+    mapped_file& operator=(mapped_file const &) = delete;
+
+    ~mapped_file()
+    {
+#ifdef QUICKSVG_HAS_MMAP
+        if (data_)
+        {
+            ::munmap(const_cast<unsigned char*>(data_), size_);
+        }
+#endif
+    }
+
+    const unsigned char* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifndef QUICKSVG_HAS_MMAP
+    std::vector<unsigned char> buffer_;
+#endif
+};
+
+}}
+#endif
@@ -0,0 +1,86 @@
+#ifndef QUICKSVG_DETAIL_OCCUPANCY_HPP
+#define QUICKSVG_DETAIL_OCCUPANCY_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace quicksvg { namespace detail {
+
+// One bit per pixel of a width x height canvas whose top left pixel is (left, top), to draw at most one dot per pixel:
+// a dot on a pixel that already has one is invisible. Dots off the canvas cannot be seen at all.
+class pixel_occupancy
+{
+public:
+    // An empty canvas, on which nothing is ever claimed.
+    pixel_occupancy() = default;
+
+    pixel_occupancy(int left, int top, int width, int height) :
+        left_{left}, top_{top}, width_{width}, height_{height},
+        bits_(static_cast<size_t>(width)*static_cast<size_t>(height))
+    {
+    }
+
+    // Whether (x, y) is on the canvas, on a pixel nothing has claimed before.
+    bool claim(double x, double y)
+    {
+        double column = std::floor(x) - left_;
+        double row = std::floor(y) - top_;
+        if (!(column >= 0 && column < width_ && row >= 0 && row < height_))
+        {
+            return false;
+        }
+        size_t k = static_cast<size_t>(row)*static_cast<size_t>(width_) + static_cast<size_t>(column);
+        if (bits_[k])
+        {
+            return false;
+        }
+        bits_[k] = true;
+        return true;
+    }
+
+private:
+    int left_ = 0;
+    int top_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<bool> bits_;
+};
+
+// The first point to land on each pixel of a canvas, in the order the points arrive.
+class pixel_dots
+{
+public:
+    pixel_dots() = default;
+
+    pixel_dots(int left, int top, int width, int height) : occupied_(left, top, width, height)
+    {
+    }
+
+    void push(double x, double y)
+    {
+        if (occupied_.claim(x, y))
+        {
+            x_.push_back(x);
+            y_.push_back(y);
+        }
+    }
+
+    std::vector<double> const & x() const
+    {
+        return x_;
+    }
+
+    std::vector<double> const & y() const
+    {
+        return y_;
+    }
+
+private:
+    pixel_occupancy occupied_;
+    std::vector<double> x_;
+    std::vector<double> y_;
+};
+
+}}
+#endif
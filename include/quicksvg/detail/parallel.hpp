@@ -0,0 +1,92 @@
+#ifndef QUICKSVG_DETAIL_PARALLEL_HPP
+#define QUICKSVG_DETAIL_PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace quicksvg { namespace detail {
+
+// threads == 0 means "use every core".
+inline unsigned thread_count(size_t work_items, unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+    if (work_items < threads)
+    {
+        threads = static_cast<unsigned>(std::max<size_t>(work_items, 1));
+    }
+    return threads;
+}
+
+// Splits [0, n) into thread_count(n, threads) contiguous blocks and calls f(block_index, begin, end) once per block.
+// Block t always covers the same indices for a given thread count, and the first exception (by block index) is rethrown.
+template<class F>
+void parallel_blocks(size_t n, unsigned threads, F f)
+{
+    threads = thread_count(n, threads);
+    if (threads == 1)
+    {
+        f(0u, size_t(0), n);
+        return;
+    }
+
+    size_t chunk = (n + threads - 1)/threads;
+    std::vector<std::exception_ptr> errors(threads);
+    auto run = [&](unsigned t)
+    {
+        size_t begin = std::min(n, t*chunk);
+        size_t end = std::min(n, begin + chunk);
+        try
+        {
+            f(t, begin, end);
+        }
+        catch (...)
+        {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        workers.emplace_back(run, t);
+    }
+    run(0);
+    for (auto & w : workers)
+    {
+        w.join();
+    }
+    for (auto const & e : errors)
+    {
+        if (e)
+        {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+// Calls f(i) for each i in [0, n). Every index is handled independently, so the result cannot depend on the thread count.
+template<class F>
+void parallel_for(size_t n, unsigned threads, F f)
+{
+    parallel_blocks(n, threads, [&f](unsigned, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            f(i);
+        }
+    });
+}
+
+}}
+#endif
@@ -0,0 +1,378 @@
+#ifndef QUICKSVG_DETAIL_PATH_HPP
+#define QUICKSVG_DETAIL_PATH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "format.hpp"
+
+namespace quicksvg { namespace detail {
+
+// Polylines with more points than this are decimated before they are written.
+constexpr size_t default_decimation_threshold = 10000;
+
+// Indices of the points of a polyline in screen coordinates, with non-decreasing x, that survive M4 decimation:
+// in each pixel column, the first, last, lowest and highest points. The rasterized line is unchanged.
+template<class Real>
+std::vector<size_t> m4_decimate(std::vector<Real> const & x, std::vector<Real> const & y)
+{
+    using std::floor;
+    std::vector<size_t> kept;
+    size_t n = x.size();
+    size_t begin = 0;
+    while (begin < n)
+    {
+        double column = floor(static_cast<double>(x[begin]));
+        size_t end = begin + 1;
+        size_t lo = begin;
+        size_t hi = begin;
+        while (end < n && floor(static_cast<double>(x[end])) == column)
+        {
+            if (y[end] < y[lo])
+            {
+                lo = end;
+            }
+            if (y[end] > y[hi])
+            {
+                hi = end;
+            }
+            ++end;
+        }
+        // The four points in index order, without repeats:
+        size_t candidates[4] = {begin, std::min(lo, hi), std::max(lo, hi), end - 1};
+        for (size_t c : candidates)
+        {
+            if (kept.empty() || kept.back() < c)
+            {
+                kept.push_back(c);
+            }
+        }
+        begin = end;
+    }
+    return kept;
+}
+
+// m4_decimate for points that arrive one at a time. Up to max_points points are held as they are;
+// past that, only the M4 points of each pixel column are, so memory is O(width) however many points arrive.
+class m4_stream
+{
+public:
+    explicit m4_stream(size_t max_points = default_decimation_threshold) : max_points_{max_points}
+    {
+    }
+
+    void push(double x, double y)
+    {
+        if (!decimating_)
+        {
+            x_.push_back(x);
+            y_.push_back(y);
+            if (x_.size() > max_points_)
+            {
+                decimating_ = true;
+                std::vector<double> held_x;
+                std::vector<double> held_y;
+                held_x.swap(x_);
+                held_y.swap(y_);
+                for (size_t i = 0; i < held_x.size(); ++i)
+                {
+                    add(held_x[i], held_y[i]);
+                }
+            }
+            return;
+        }
+        add(x, y);
+    }
+
+    // The points to draw, which are then cleared. Returns whether they were decimated;
+    // if so, pass max_points = 0 to write_path_points so that Douglas-Peucker still applies.
+    bool finish(std::vector<double> & x, std::vector<double> & y)
+    {
+        bool decimated = decimating_;
+        if (decimating_)
+        {
+            flush_column();
+        }
+        x.swap(x_);
+        y.swap(y_);
+        x_.clear();
+        y_.clear();
+        decimating_ = false;
+        count_ = 0;
+        return decimated;
+    }
+
+private:
+    struct point
+    {
+        size_t index;
+        double x;
+        double y;
+    };
+
+    void add(double x, double y)
+    {
+        double column = std::floor(x);
+        point p{count_++, x, y};
+        if (count_ > 1 && column == column_)
+        {
+            if (y < lo_.y)
+            {
+                lo_ = p;
+            }
+            if (y > hi_.y)
+            {
+                hi_ = p;
+            }
+            last_ = p;
+            return;
+        }
+        if (count_ > 1)
+        {
+            flush_column();
+        }
+        column_ = column;
+        first_ = lo_ = hi_ = last_ = p;
+    }
+
+    // The four points in index order, without repeats, as in m4_decimate:
+    void flush_column()
+    {
+        point const & a = lo_.index < hi_.index ? lo_ : hi_;
+        point const & b = lo_.index < hi_.index ? hi_ : lo_;
+        size_t kept = first_.index;
+        x_.push_back(first_.x);
+        y_.push_back(first_.y);
+        point const * candidates[3] = {&a, &b, &last_};
+        for (point const * p : candidates)
+        {
+            if (p->index > kept)
+            {
+                kept = p->index;
+                x_.push_back(p->x);
+                y_.push_back(p->y);
+            }
+        }
+    }
+
+    size_t max_points_;
+    bool decimating_ = false;
+    size_t count_ = 0;
+    double column_ = 0;
+    point first_{};
+    point lo_{};
+    point hi_{};
+    point last_{};
+    std::vector<double> x_;
+    std::vector<double> y_;
+};
+
+// Douglas-Peucker simplification of the polyline through x[indices[k]], y[indices[k]]:
+// drops every point within tolerance pixels of the simplified line. The endpoints are always kept.
+template<class Real>
+std::vector<size_t> douglas_peucker(std::vector<Real> const & x, std::vector<Real> const & y,
+                                    std::vector<size_t> const & indices, double tolerance)
+{
+    using std::abs;
+    using std::sqrt;
+    size_t n = indices.size();
+    if (n < 3)
+    {
+        return indices;
+    }
+    std::vector<bool> keep(n, false);
+    keep[0] = true;
+    keep[n - 1] = true;
+    std::vector<std::pair<size_t, size_t>> stack{{0, n - 1}};
+    while (!stack.empty())
+    {
+        size_t first = stack.back().first;
+        size_t last = stack.back().second;
+        stack.pop_back();
+        double x0 = static_cast<double>(x[indices[first]]);
+        double y0 = static_cast<double>(y[indices[first]]);
+        double dx = static_cast<double>(x[indices[last]]) - x0;
+        double dy = static_cast<double>(y[indices[last]]) - y0;
+        double length = sqrt(dx*dx + dy*dy);
+        double worst = -1;
+        size_t worst_k = first;
+        for (size_t k = first + 1; k < last; ++k)
+        {
+            double px = static_cast<double>(x[indices[k]]) - x0;
+            double py = static_cast<double>(y[indices[k]]) - y0;
+            double d = length > 0 ? abs(px*dy - py*dx)/length : sqrt(px*px + py*py);
+            if (d > worst)
+            {
+                worst = d;
+                worst_k = k;
+            }
+        }
+        if (worst > tolerance)
+        {
+            keep[worst_k] = true;
+            stack.emplace_back(first, worst_k);
+            stack.emplace_back(worst_k, last);
+        }
+    }
+
+    std::vector<size_t> kept;
+    for (size_t k = 0; k < n; ++k)
+    {
+        if (keep[k])
+        {
+            kept.push_back(indices[k]);
+        }
+    }
+    return kept;
+}
+
+// Relative path data for the points x[index(k)], y[index(k)], k < n, snapped to a grid of quantum pixels:
+// "M x0 y0" and then l/h/v steps, with repeated commands left implicit and consecutive duplicates dropped.
+// The steps are integers in units of the stream's coordinate decimals, so they add up exactly to the snapped positions.
+template<class Real, class Index>
+void write_compact_path_points(std::ostream & os, std::vector<Real> const & x, std::vector<Real> const & y,
+                               size_t n, Index index, double quantum)
+{
+    using std::isfinite;
+    int decimals = stream_coordinate_decimals(os);
+    double scale = std::pow(10.0, decimals);
+    auto snap = [&](Real const & v)
+    {
+        return std::llround(std::round(static_cast<double>(v)/quantum)*quantum*scale);
+    };
+
+    char command = 0;
+    bool separate = false;
+    bool has_dot = false;
+    auto number = [&](long long units)
+    {
+        char buffer[34];
+        char* begin = buffer + 1;
+        char* end = format_coordinate(begin, units/scale, decimals);
+        // "0.5" -> ".5" and "-0.5" -> "-.5":
+        if (begin[0] == '0' && begin[1] == '.')
+        {
+            ++begin;
+        }
+        else if (begin[0] == '-' && begin[1] == '0' && begin[2] == '.')
+        {
+            begin[1] = '-';
+            ++begin;
+        }
+        // A new number starts at a minus sign, or at a second decimal point:
+        if (separate && begin[0] != '-' && !(begin[0] == '.' && has_dot))
+        {
+            *--begin = ' ';
+        }
+        has_dot = std::find(begin, end, '.') != end;
+        separate = true;
+        os.write(begin, end - begin);
+    };
+    auto segment = [&](char c, long long dx, long long dy)
+    {
+        if (c != command)
+        {
+            os.put(c);
+            command = c;
+            separate = false;
+        }
+        if (c != 'v')
+        {
+            number(dx);
+        }
+        if (c != 'h')
+        {
+            number(dy);
+        }
+    };
+
+    size_t k = 0;
+    while (k < n && !(isfinite(x[index(k)]) && isfinite(y[index(k)])))
+    {
+        ++k;
+    }
+    if (k == n)
+    {
+        return;
+    }
+    long long px = snap(x[index(k)]);
+    long long py = snap(y[index(k)]);
+    segment('M', px, py);
+    // Axis-aligned steps in the same direction are merged before they are written:
+    char pending = 0;
+    long long pending_dx = 0;
+    long long pending_dy = 0;
+    for (++k; k < n; ++k)
+    {
+        if (!(isfinite(x[index(k)]) && isfinite(y[index(k)])))
+        {
+            continue;
+        }
+        long long qx = snap(x[index(k)]);
+        long long qy = snap(y[index(k)]);
+        long long dx = qx - px;
+        long long dy = qy - py;
+        if (dx == 0 && dy == 0)
+        {
+            continue;
+        }
+        char c = dy == 0 ? 'h' : dx == 0 ? 'v' : 'l';
+        if (c != 'l' && c == pending && (dx < 0) == (pending_dx < 0) && (dy < 0) == (pending_dy < 0))
+        {
+            pending_dx += dx;
+            pending_dy += dy;
+        }
+        else
+        {
+            if (pending)
+            {
+                segment(pending, pending_dx, pending_dy);
+            }
+            pending = c;
+            pending_dx = dx;
+            pending_dy = dy;
+        }
+        px = qx;
+        py = qy;
+    }
+    if (pending)
+    {
+        segment(pending, pending_dx, pending_dy);
+    }
+}
+
+// Writes the points of a polyline already in screen coordinates as path data, "M x0 y0 L x1 y1 ...".
+// Polylines with more than max_points points are first reduced by M4 decimation and, if tolerance > 0, Douglas-Peucker.
+// quantum > 0 selects the compact relative encoding on a grid of quantum pixels.
+template<class Real>
+void write_path_points(std::ostream & os, std::vector<Real> const & x, std::vector<Real> const & y,
+                       size_t max_points = default_decimation_threshold, double tolerance = 0, double quantum = 0)
+{
+    std::vector<size_t> kept;
+    if (x.size() > max_points)
+    {
+        kept = m4_decimate(x, y);
+        if (tolerance > 0)
+        {
+            kept = douglas_peucker(x, y, kept, tolerance);
+        }
+    }
+    size_t n = kept.empty() ? x.size() : kept.size();
+    auto index = [&kept](size_t k) { return kept.empty() ? k : kept[k]; };
+    if (quantum > 0)
+    {
+        write_compact_path_points(os, x, y, n, index, quantum);
+        return;
+    }
+    os << "M" << coordinate(x[index(0)]) << " " << coordinate(y[index(0)]);
+    for (size_t k = 1; k < n; ++k)
+    {
+        os << " L" << coordinate(x[index(k)]) << " " << coordinate(y[index(k)]);
+    }
+}
+
+}}
+#endif
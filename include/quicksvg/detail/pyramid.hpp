@@ -0,0 +1,258 @@
+#ifndef QUICKSVG_DETAIL_PYRAMID_HPP
+#define QUICKSVG_DETAIL_PYRAMID_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "parallel.hpp"
+
+namespace quicksvg { namespace detail {
+
+// The indices of the smallest and largest sample of each block of block_size samples, then of each pair of blocks,
+// and so on up to the whole series. The extremes of any index range then cost O(log n) lookups plus a scan of
+// at most two partial blocks, O(log n + block_size) in all. Ties go to the earliest index, as in m4_decimate.
+class minmax_pyramid
+{
+public:
+    static constexpr size_t block_size = 1024;
+
+    template<class View>
+    explicit minmax_pyramid(View const & v, unsigned threads = 1) : size_{v.size()}
+    {
+        std::vector<extremes> level((size_ + block_size - 1)/block_size);
+        parallel_for(level.size(), threads, [&](size_t k)
+        {
+            level[k] = scan(v, k*block_size, std::min(size_, (k + 1)*block_size));
+        });
+        levels_.push_back(std::move(level));
+        while (levels_.back().size() > 1)
+        {
+            std::vector<extremes> const & below = levels_.back();
+            std::vector<extremes> above((below.size() + 1)/2);
+            for (size_t k = 0; k < above.size(); ++k)
+            {
+                above[k] = below[2*k];
+                if (2*k + 1 < below.size())
+                {
+                    merge(v, above[k], below[2*k + 1]);
+                }
+            }
+            levels_.push_back(std::move(above));
+        }
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    // Indices of the smallest and largest of v[begin], ..., v[end - 1]; requires begin < end <= size().
+    template<class View>
+    std::pair<size_t, size_t> query(View const & v, size_t begin, size_t end) const
+    {
+        size_t first_block = (begin + block_size - 1)/block_size;
+        size_t last_block = end/block_size;
+        if (first_block >= last_block)
+        {
+            extremes e = scan(v, begin, end);
+            return {e.lo, e.hi};
+        }
+        extremes e = scan(v, begin, first_block*block_size);
+        bool found = begin < first_block*block_size;
+        auto take = [&](extremes const & other)
+        {
+            if (found)
+            {
+                merge(v, e, other);
+            }
+            else
+            {
+                e = other;
+                found = true;
+            }
+        };
+        if (last_block*block_size < end)
+        {
+            take(scan(v, last_block*block_size, end));
+        }
+        // Bottom-up over the whole blocks [first_block, last_block):
+        for (size_t level = 0; first_block < last_block; ++level)
+        {
+            if (first_block & 1)
+            {
+                take(levels_[level][first_block++]);
+            }
+            if (last_block & 1)
+            {
+                take(levels_[level][--last_block]);
+            }
+            first_block /= 2;
+            last_block /= 2;
+        }
+        return {e.lo, e.hi};
+    }
+
+    // Writes to a temporary file and renames it into place, so a reader never loads a partial index.
+    void save(std::string const & filename) const
+    {
+        std::string tmp = filename + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary);
+            ofs.write(magic, sizeof(magic));
+            write_u64(ofs, size_);
+            write_u64(ofs, block_size);
+            write_u64(ofs, levels_.size());
+            for (auto const & level : levels_)
+            {
+                write_u64(ofs, level.size());
+                for (auto const & e : level)
+                {
+                    write_u64(ofs, e.lo);
+                    write_u64(ofs, e.hi);
+                }
+            }
+            if (!ofs)
+            {
+                std::remove(tmp.c_str());
+                throw std::runtime_error("Unable to write " + tmp);
+            }
+        }
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Unable to write " + filename);
+        }
+    }
+
+    // A pyramid saved for a series of `size` samples.
+    static minmax_pyramid load(std::string const & filename, size_t size)
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        char header[sizeof(magic)];
+        ifs.read(header, sizeof(header));
+        if (!ifs || std::memcmp(header, magic, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error("Unable to read a min/max index from " + filename);
+        }
+        minmax_pyramid p;
+        p.size_ = read_u64(ifs);
+        if (read_u64(ifs) != block_size || p.size_ != size)
+        {
+            throw std::domain_error("The min/max index in " + filename + " was built for " + std::to_string(p.size_)
+                                    + " samples, not " + std::to_string(size));
+        }
+        // The shape is fixed by the size, so anything else is a damaged file, as is an index outside the series:
+        size_t expected = (size + block_size - 1)/block_size;
+        size_t levels = read_u64(ifs);
+        if (levels != level_count(size))
+        {
+            throw std::runtime_error("The min/max index in " + filename + " has " + std::to_string(levels)
+                                     + " levels, not " + std::to_string(level_count(size)));
+        }
+        for (size_t l = 0; l < levels && ifs; ++l)
+        {
+            size_t count = read_u64(ifs);
+            if (ifs && count != expected)
+            {
+                throw std::runtime_error("Level " + std::to_string(l) + " of the min/max index in " + filename + " has "
+                                         + std::to_string(count) + " entries, not " + std::to_string(expected));
+            }
+            std::vector<extremes> level(count);
+            for (size_t k = 0; k < level.size() && ifs; ++k)
+            {
+                level[k].lo = read_u64(ifs);
+                level[k].hi = read_u64(ifs);
+                if (ifs && (level[k].lo >= size || level[k].hi >= size))
+                {
+                    throw std::runtime_error("The min/max index in " + filename + " refers to samples past the end of the series.");
+                }
+            }
+            p.levels_.push_back(std::move(level));
+            expected = (expected + 1)/2;
+        }
+        if (!ifs)
+        {
+            throw std::runtime_error("Truncated min/max index in " + filename);
+        }
+        return p;
+    }
+
+private:
+    static constexpr char magic[8] = {'q', 's', 'v', 'g', 'm', 'm', 'p', '1'};
+
+    struct extremes
+    {
+        size_t lo;
+        size_t hi;
+    };
+
+    minmax_pyramid() = default;
+
+    // Level 0 has a block per block_size samples, and each level above half as many, rounded up, down to one.
+    static size_t level_count(size_t size)
+    {
+        size_t levels = 1;
+        for (size_t blocks = (size + block_size - 1)/block_size; blocks > 1; blocks = (blocks + 1)/2)
+        {
+            ++levels;
+        }
+        return levels;
+    }
+
+    template<class View>
+    static extremes scan(View const & v, size_t begin, size_t end)
+    {
+        extremes e{begin, begin};
+        for (size_t i = begin + 1; i < end; ++i)
+        {
+            if (v[i] < v[e.lo])
+            {
+                e.lo = i;
+            }
+            if (v[i] > v[e.hi])
+            {
+                e.hi = i;
+            }
+        }
+        return e;
+    }
+
+    // Pieces are not merged in index order, so ties are settled by index:
+    template<class View>
+    static void merge(View const & v, extremes & e, extremes const & other)
+    {
+        if (v[other.lo] < v[e.lo] || (!(v[e.lo] < v[other.lo]) && other.lo < e.lo))
+        {
+            e.lo = other.lo;
+        }
+        if (v[other.hi] > v[e.hi] || (!(v[e.hi] > v[other.hi]) && other.hi < e.hi))
+        {
+            e.hi = other.hi;
+        }
+    }
+
+    static void write_u64(std::ofstream & ofs, uint64_t x)
+    {
+        ofs.write(reinterpret_cast<char const *>(&x), sizeof(x));
+    }
+
+    static uint64_t read_u64(std::ifstream & ifs)
+    {
+        uint64_t x = 0;
+        ifs.read(reinterpret_cast<char*>(&x), sizeof(x));
+        return x;
+    }
+
+    size_t size_ = 0;
+    std::vector<std::vector<extremes>> levels_;
+};
+
+}}
+#endif
@@ -0,0 +1,252 @@
+#ifndef QUICKSVG_DETAIL_REFERENCE_CACHE_HPP
+#define QUICKSVG_DETAIL_REFERENCE_CACHE_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "mapped_file.hpp"
+
+namespace quicksvg {
+
+// Opt-in on-disk cache of the reference data computed by the ulp_plot constructor.
+// The file name is derived from function_id and the sampling parameters; an empty function_id disables the cache.
+// Files are written in native byte order and are only meant to be reused on the machine that wrote them.
+struct reference_cache
+{
+    std::string function_id;
+    std::string directory = ".";
+};
+
+namespace detail {
+
+// Bump whenever the sampling or evaluation changes in a way that invalidates previously written files.
+constexpr uint32_t reference_cache_version = 4;
+constexpr char reference_cache_magic[8] = {'Q', 'S', 'V', 'G', 'U', 'L', 'P', '\0'};
+
+// Fixed-size binary record for a Real. Trivially copyable types are stored as-is;
+// multiprecision types are stored exactly as a binary exponent plus 32-bit mantissa words.
+template<class Real, bool = std::is_trivially_copyable<Real>::value>
+struct real_codec
+{
+    static constexpr size_t record_size = sizeof(Real);
+
+    static void encode(Real const & x, unsigned char* out)
+    {
+        std::memcpy(out, &x, sizeof(Real));
+    }
+
+    static Real decode(const unsigned char* in)
+    {
+        Real x;
+        std::memcpy(&x, in, sizeof(Real));
+        return x;
+    }
+};
+
+template<class Real>
+struct real_codec<Real, false>
+{
+    static constexpr size_t words = (std::numeric_limits<Real>::digits + 31)/32;
+    static constexpr size_t record_size = 8 + 4*words;
+
+    static void encode(Real const & x, unsigned char* out)
+    {
+        using std::abs;
+        using std::floor;
+        using std::frexp;
+        using std::isinf;
+        using std::isnan;
+        using std::ldexp;
+        std::memset(out, 0, record_size);
+        int32_t exponent = 0;
+        unsigned char kind = 0;
+        if (isnan(x))
+        {
+            kind = 3;
+        }
+        else if (isinf(x))
+        {
+            kind = 2;
+        }
+        else if (x != 0)
+        {
+            kind = 1;
+            int e;
+            Real m = frexp(abs(x), &e);
+            exponent = e;
+            for (size_t i = 0; i < words; ++i)
+            {
+                m = ldexp(m, 32);
+                Real d = floor(m);
+                uint32_t w = static_cast<uint32_t>(d);
+                std::memcpy(out + 8 + 4*i, &w, 4);
+                m -= d;
+            }
+        }
+        std::memcpy(out, &exponent, 4);
+        out[4] = kind;
+        out[5] = x < 0;
+    }
+
+    static Real decode(const unsigned char* in)
+    {
+        using std::ldexp;
+        int32_t exponent;
+        std::memcpy(&exponent, in, 4);
+        unsigned char kind = in[4];
+        bool negative = in[5];
+        Real x = 0;
+        if (kind == 3)
+        {
+            return std::numeric_limits<Real>::quiet_NaN();
+        }
+        if (kind == 2)
+        {
+            x = std::numeric_limits<Real>::infinity();
+        }
+        else if (kind == 1)
+        {
+            for (size_t i = words; i-- > 0; )
+            {
+                uint32_t w;
+                std::memcpy(&w, in + 8 + 4*i, 4);
+                x = ldexp(x + Real(w), -32);
+            }
+            x = ldexp(x, exponent);
+        }
+        return negative ? Real(-x) : x;
+    }
+};
+
+inline std::string reference_cache_path(reference_cache const & cache, std::string const & key)
+{
+    // FNV-1a; the full key is also stored in the file, so a collision only costs a recomputation.
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : key)
+    {
+        h = (h ^ c)*1099511628211ull;
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+    std::string dir = cache.directory.empty() ? "." : cache.directory;
+    return dir + "/" + cache.function_id + "_" + hex + ".ulpref";
+}
+
+// Returns false (leaving the vectors untouched) if the file is missing, truncated, or was written for another key.
+// The condition numbers are optional: cond is left empty if the file was written without them.
+template<class Real>
+bool load_reference(std::string const & filename, std::string const & key, size_t samples,
+                    std::vector<Real>& abscissas, std::vector<Real>& ordinates, std::vector<Real>& cond)
+{
+    using codec = real_codec<Real>;
+    mapped_file file(filename);
+    const unsigned char* p = file.data();
+    size_t header = sizeof(reference_cache_magic) + 4 + 4 + key.size() + 8 + 4 + 4;
+    if (p == nullptr || file.size() < header)
+    {
+        return false;
+    }
+    if (std::memcmp(p, reference_cache_magic, sizeof(reference_cache_magic)) != 0)
+    {
+        return false;
+    }
+    p += sizeof(reference_cache_magic);
+
+    uint32_t version, key_size, record_size, has_cond;
+    uint64_t n;
+    std::memcpy(&version, p, 4);
+    std::memcpy(&key_size, p + 4, 4);
+    p += 8;
+    if (version != reference_cache_version || key_size != key.size() || std::memcmp(p, key.data(), key_size) != 0)
+    {
+        return false;
+    }
+    p += key_size;
+    std::memcpy(&n, p, 8);
+    std::memcpy(&record_size, p + 8, 4);
+    std::memcpy(&has_cond, p + 12, 4);
+    p += 16;
+    if (n != samples || record_size != codec::record_size || has_cond > 1
+        || file.size() != header + (2 + has_cond)*n*codec::record_size)
+    {
+        return false;
+    }
+
+    abscissas.resize(samples);
+    ordinates.resize(samples);
+    cond.resize(has_cond ? samples : 0);
+    for (auto* v : {&abscissas, &ordinates, &cond})
+    {
+        if (v->empty())
+        {
+            continue;
+        }
+        for (size_t i = 0; i < samples; ++i)
+        {
+            (*v)[i] = codec::decode(p);
+            p += codec::record_size;
+        }
+    }
+    return true;
+}
+
+// Writes to a temporary file and renames it into place, so concurrent readers never see a partial cache.
+template<class Real>
+void save_reference(std::string const & filename, std::string const & key,
+                    std::vector<Real> const & abscissas, std::vector<Real> const & ordinates, std::vector<Real> const & cond)
+{
+    using codec = real_codec<Real>;
+    uint32_t version = reference_cache_version;
+    uint32_t key_size = static_cast<uint32_t>(key.size());
+    uint64_t n = abscissas.size();
+    uint32_t record_size = codec::record_size;
+    uint32_t has_cond = cond.size() == n;
+
+    std::string bytes;
+    bytes.reserve(sizeof(reference_cache_magic) + 24 + key.size() + (2 + has_cond)*n*codec::record_size);
+    bytes.append(reference_cache_magic, sizeof(reference_cache_magic));
+    bytes.append(reinterpret_cast<const char*>(&version), 4);
+    bytes.append(reinterpret_cast<const char*>(&key_size), 4);
+    bytes.append(key);
+    bytes.append(reinterpret_cast<const char*>(&n), 8);
+    bytes.append(reinterpret_cast<const char*>(&record_size), 4);
+    bytes.append(reinterpret_cast<const char*>(&has_cond), 4);
+    unsigned char record[codec::record_size];
+    for (auto const * v : {&abscissas, &ordinates, &cond})
+    {
+        if (v == &cond && !has_cond)
+        {
+            continue;
+        }
+        for (auto const & x : *v)
+        {
+            codec::encode(x, record);
+            bytes.append(reinterpret_cast<const char*>(record), codec::record_size);
+        }
+    }
+
+    std::string tmp = filename + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        ofs.write(bytes.data(), bytes.size());
+        if (!ofs)
+        {
+            throw std::runtime_error("Unable to write reference cache " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Unable to write reference cache " + filename);
+    }
+}
+
+}}
+#endif
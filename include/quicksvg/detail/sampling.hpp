@@ -0,0 +1,154 @@
+#ifndef QUICKSVG_DETAIL_SAMPLING_HPP
+#define QUICKSVG_DETAIL_SAMPLING_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "float_bits.hpp"
+#include "parallel.hpp"
+
+namespace quicksvg { namespace detail {
+
+// Counter-based generator: the i-th random number depends only on (seed, i), so any range of the stream
+// can be generated independently on any thread. SplitMix64's finalizer applied to a Weyl sequence.
+inline uint64_t counter_hash(uint64_t seed, uint64_t counter)
+{
+    uint64_t z = seed*0xd1342543de82ef95ull + (counter + 1)*0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Uniform on (0, 1].
+inline double counter_uniform(uint64_t seed, uint64_t counter)
+{
+    return std::ldexp(static_cast<double>((counter_hash(seed, counter) >> 11) + 1), -53);
+}
+
+// Fills x with n sorted uniform variates on (a, b) in O(n), without sorting:
+// with E_1, ..., E_{n+1} i.i.d. exponential and S_k = E_1 + ... + E_k, the ratios S_k/S_{n+1} are distributed
+// as the order statistics of n uniforms. Prefix sums are formed over fixed-size blocks, so the result is
+// the same for any thread count.
+template<class Real>
+void uniform_order_statistics(std::vector<Real>& x, Real const & a, Real const & b, uint64_t seed, unsigned threads)
+{
+    using std::log;
+    constexpr size_t block_size = 4096;
+    size_t n = x.size();
+    size_t blocks = (n + block_size - 1)/block_size;
+    std::vector<Real> block_sums(blocks);
+
+    parallel_for(blocks, threads, [&](size_t blk)
+    {
+        size_t end = std::min(n, (blk + 1)*block_size);
+        Real s = 0;
+        for (size_t i = blk*block_size; i < end; ++i)
+        {
+            s += -log(counter_uniform(seed, i));
+            x[i] = s;
+        }
+        block_sums[blk] = s;
+    });
+
+    // block_sums[blk] becomes the offset of block blk:
+    Real total = 0;
+    for (size_t blk = 0; blk < blocks; ++blk)
+    {
+        Real s = block_sums[blk];
+        block_sums[blk] = total;
+        total += s;
+    }
+    total += -log(counter_uniform(seed, n));
+    Real scale = (b - a)/total;
+
+    parallel_for(blocks, threads, [&](size_t blk)
+    {
+        size_t end = std::min(n, (blk + 1)*block_size);
+        for (size_t i = blk*block_size; i < end; ++i)
+        {
+            x[i] = a + (block_sums[blk] + x[i])*scale;
+        }
+    });
+}
+
+// One jittered sample in each of n equal strata of (a, b). Every pixel column receives a sample once n >= the plot width.
+template<class Real>
+void stratified_uniform(std::vector<Real>& x, Real const & a, Real const & b, uint64_t seed, unsigned threads)
+{
+    size_t n = x.size();
+    Real h = (b - a)/n;
+    parallel_for(n, threads, [&](size_t i)
+    {
+        x[i] = a + (i + Real(1 - counter_uniform(seed, i)))*h;
+    });
+}
+
+// The van der Corput sequence in base 2 (the one-dimensional Sobol sequence), randomized by a seed-dependent digital shift.
+template<class Real>
+void van_der_corput(std::vector<Real>& x, Real const & a, Real const & b, uint64_t seed)
+{
+    using std::ldexp;
+    size_t n = x.size();
+    uint64_t shift = counter_hash(seed, 0);
+    std::vector<uint64_t> v(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t k = i;
+        uint64_t r = 0;
+        for (int bit = 63; k != 0; --bit, k >>= 1)
+        {
+            r |= (k & 1) << bit;
+        }
+        v[i] = r ^ shift;
+    }
+    // Sorting 64-bit integers is far cheaper than sorting multiprecision values:
+    std::sort(v.begin(), v.end());
+    Real h = b - a;
+    for (size_t i = 0; i < n; ++i)
+    {
+        // Keep the top 53 bits and centre the point in its 2^-53 cell, so it never lands exactly on a:
+        x[i] = a + h*ldexp(Real(v[i] >> 11) + Real(0.5), -53);
+    }
+}
+
+// Uniform over the representable values of Coarse in [a, b] rather than over the real line,
+// which spreads samples evenly over binades on intervals like [0, 10^6].
+// With jitter, each sample is moved less than half-way towards the next representable value, so it still rounds to the same Coarse.
+template<class Coarse, class Real>
+void ulp_uniform(std::vector<Real>& x, Coarse a, Coarse b, uint64_t seed, bool jitter)
+{
+    using U = typename float_bits<Coarse>::type;
+    size_t n = x.size();
+    U first = to_ordered(a);
+    uint64_t range = static_cast<uint64_t>(to_ordered(b) - first) + 1;
+    // Hashes below 2^64 mod range are drawn again, which leaves every residue equally likely; plain h % range would
+    // favour the low end of the interval by up to a factor of 2 when range is not a power of 2.
+    uint64_t reject_below = range == 0 ? 0 : (0 - range) % range;
+    std::vector<U> keys(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t h = counter_hash(seed, i);
+        while (h < reject_below)
+        {
+            h = counter_hash(h, i);
+        }
+        keys[i] = first + static_cast<U>(range == 0 ? h : h % range);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < n; ++i)
+    {
+        Coarse c = from_ordered<Coarse>(keys[i]);
+        x[i] = c;
+        if (jitter && c < b)
+        {
+            Coarse next = from_ordered<Coarse>(keys[i] + 1);
+            // Uniform on [0, 1), so the sample never reaches the midpoint, which could round up to next:
+            double u = std::ldexp(static_cast<double>(counter_hash(seed, n + i) >> 11), -53);
+            x[i] += (Real(next) - Real(c))*Real(u)/2;
+        }
+    }
+}
+
+}}
+#endif
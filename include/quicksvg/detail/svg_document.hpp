@@ -0,0 +1,273 @@
+#ifndef QUICKSVG_DETAIL_SVG_DOCUMENT_HPP
+#define QUICKSVG_DETAIL_SVG_DOCUMENT_HPP
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compressed output needs zlib: build with -DQUICKSVG_HAS_ZLIB and link with -lz.
+#ifdef QUICKSVG_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace quicksvg { namespace detail {
+
+// In gzip mode, text is deflated whenever this much has been buffered.
+constexpr size_t gzip_chunk_size = 1 << 16;
+
+// .svgz and .svg.gz files are written compressed.
+inline bool is_gzip_filename(std::string const & filename)
+{
+    auto ends_with = [&filename](std::string const & suffix)
+    {
+        return filename.size() >= suffix.size() && filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return ends_with(".svgz") || ends_with(".svg.gz");
+}
+
+// Asking for compressed output without zlib throws here, when the plot is set up, rather than when it is written.
+inline bool checked_gzip(bool gzip)
+{
+#ifndef QUICKSVG_HAS_ZLIB
+    if (gzip)
+    {
+        throw std::logic_error("Compressed output requires zlib; compile with -DQUICKSVG_HAS_ZLIB and link with -lz.");
+    }
+#endif
+    return gzip;
+}
+
+// A streambuf writing into one growable contiguous array, whose capacity can be reserved up front.
+// In gzip mode the text is instead deflated chunk by chunk as it is written, so only the compressed document is held.
+class document_buffer : public std::streambuf
+{
+public:
+    document_buffer() = default;
+    document_buffer(document_buffer const &) = delete;
+    document_buffer& operator=(document_buffer const &) = delete;
+
+    ~document_buffer()
+    {
+#ifdef QUICKSVG_HAS_ZLIB
+        if (gzip_)
+        {
+            deflateEnd(&zs_);
+        }
+#endif
+    }
+
+    void reserve(size_t bytes)
+    {
+        if (gzip_)
+        {
+            // SVG text compresses about 10:1:
+            compressed_.reserve(bytes/8);
+        }
+        else if (bytes > used())
+        {
+            make_room(bytes - used());
+        }
+    }
+
+    // Everything from here on, and whatever is already buffered, goes through deflate into a gzip stream.
+    void start_gzip()
+    {
+        if (gzip_)
+        {
+            return;
+        }
+#ifdef QUICKSVG_HAS_ZLIB
+        zs_.zalloc = Z_NULL;
+        zs_.zfree = Z_NULL;
+        zs_.opaque = Z_NULL;
+        // 15 + 16 asks for a gzip header and trailer rather than a raw zlib stream:
+        if (deflateInit2(&zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("Unable to initialize zlib.");
+        }
+        gzip_ = true;
+        if (bytes_.size() < gzip_chunk_size)
+        {
+            make_room(gzip_chunk_size - used());
+        }
+#else
+        throw std::logic_error("Compressed output requires zlib; compile with -DQUICKSVG_HAS_ZLIB and link with -lz.");
+#endif
+    }
+
+    // The complete document: the text, or in gzip mode the finished gzip stream. Nothing may be written afterwards.
+    std::string_view finish()
+    {
+#ifdef QUICKSVG_HAS_ZLIB
+        if (gzip_)
+        {
+            if (!finished_)
+            {
+                compress(Z_FINISH);
+                finished_ = true;
+            }
+            return std::string_view(compressed_.data(), compressed_.size());
+        }
+#endif
+        return std::string_view(bytes_.data(), used());
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            return traits_type::not_eof(c);
+        }
+        make_room(1);
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override
+    {
+        if (n <= 0)
+        {
+            return 0;
+        }
+        make_room(n);
+        std::memcpy(pptr(), s, n);
+        advance(n);
+        return n;
+    }
+
+private:
+    size_t used() const
+    {
+        return static_cast<size_t>(pptr() - pbase());
+    }
+
+    void make_room(size_t n)
+    {
+        if (static_cast<size_t>(epptr() - pptr()) >= n)
+        {
+            return;
+        }
+#ifdef QUICKSVG_HAS_ZLIB
+        if (gzip_)
+        {
+            compress(Z_NO_FLUSH);
+            if (bytes_.size() >= n)
+            {
+                return;
+            }
+        }
+#endif
+        size_t old_used = used();
+        bytes_.resize(std::max(old_used + n, 2*bytes_.size()));
+        setp(bytes_.data(), bytes_.data() + bytes_.size());
+        advance(old_used);
+    }
+
+    // pbump takes an int:
+    void advance(size_t n)
+    {
+        while (n > 0)
+        {
+            int step = static_cast<int>(std::min(n, static_cast<size_t>(INT_MAX)));
+            pbump(step);
+            n -= step;
+        }
+    }
+
+#ifdef QUICKSVG_HAS_ZLIB
+    // Deflates the buffered text onto the end of compressed_ and empties the buffer.
+    void compress(int flush)
+    {
+        zs_.next_in = reinterpret_cast<Bytef*>(pbase());
+        zs_.avail_in = static_cast<uInt>(used());
+        int status;
+        do
+        {
+            size_t old_size = compressed_.size();
+            compressed_.resize(old_size + gzip_chunk_size);
+            zs_.next_out = reinterpret_cast<Bytef*>(compressed_.data() + old_size);
+            zs_.avail_out = static_cast<uInt>(gzip_chunk_size);
+            status = deflate(&zs_, flush);
+            if (status == Z_STREAM_ERROR)
+            {
+                throw std::runtime_error("zlib failed to compress the document.");
+            }
+            compressed_.resize(old_size + gzip_chunk_size - zs_.avail_out);
+        } while (zs_.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+        setp(bytes_.data(), bytes_.data() + bytes_.size());
+    }
+
+    z_stream zs_;
+#endif
+    std::vector<char> compressed_;
+    std::vector<char> bytes_;
+    bool gzip_ = false;
+    bool finished_ = false;
+};
+
+// An SVG built in memory and written to disk in one go by commit(). Nothing touches the file before then,
+// so a plot that throws half way leaves no truncated output behind.
+class svg_document : public std::ostream
+{
+public:
+    svg_document() : std::ostream(nullptr)
+    {
+        rdbuf(&buffer_);
+    }
+
+    svg_document(svg_document const &) = delete;
+    svg_document& operator=(svg_document const &) = delete;
+
+    void reserve(size_t bytes)
+    {
+        buffer_.reserve(bytes);
+    }
+
+    // Compress the document, including anything already written, into gzip (.svgz) format.
+    void start_gzip()
+    {
+        buffer_.start_gzip();
+    }
+
+    // The bytes commit() writes.
+    std::string str()
+    {
+        return std::string(buffer_.finish());
+    }
+
+    // A single write to a temporary file, renamed into place, so readers never see a partial document.
+    void commit(std::string const & filename)
+    {
+        std::string_view bytes = buffer_.finish();
+        std::string tmp = filename + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary);
+            ofs.write(bytes.data(), bytes.size());
+            if (!ofs)
+            {
+                throw std::runtime_error("Unable to write " + tmp);
+            }
+        }
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Unable to write " + filename);
+        }
+    }
+
+private:
+    document_buffer buffer_;
+};
+
+}}
+#endif
@@ -0,0 +1,446 @@
+#ifndef QUICKSVG_DETAIL_ULP_SVG_HPP
+#define QUICKSVG_DETAIL_ULP_SVG_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "float_bits.hpp"
+#include "generic_svg_functionality.hpp"
+#include "path.hpp"
+
+// Pieces of the ULP plot layout shared by ulp_plot and exhaustive_ulp_plot.
+
+namespace quicksvg { namespace detail {
+
+struct ulp_layout
+{
+    int width;
+    int height;
+    int margin_top;
+    int margin_left;
+    int graph_width;
+    int graph_height;
+};
+
+inline ulp_layout make_ulp_layout(int width, bool has_title)
+{
+    using std::floor;
+    ulp_layout layout;
+    layout.width = width;
+    layout.height = floor(double(width)/1.61803);
+    layout.margin_top = 40;
+    layout.margin_left = 25;
+    if (!has_title)
+    {
+        layout.margin_top = 10;
+        layout.margin_left = 15;
+    }
+    int margin_bottom = 20;
+    int margin_right = 20;
+    layout.graph_height = layout.height - margin_bottom - layout.margin_top;
+    layout.graph_width = layout.width - layout.margin_left - margin_right;
+    return layout;
+}
+
+// Error of y_lo_acc in units of the spacing of CoarseReal at y_hi_acc.
+template<class CoarseReal, class PreciseReal>
+CoarseReal ulp_distance(PreciseReal const & y_hi_acc, PreciseReal const & y_lo_acc)
+{
+    using std::abs;
+    PreciseReal absy = abs(y_hi_acc);
+    PreciseReal dist = nextafter(static_cast<CoarseReal>(absy), std::numeric_limits<CoarseReal>::max()) - static_cast<CoarseReal>(absy);
+    return static_cast<CoarseReal>((y_lo_acc - y_hi_acc)/dist);
+}
+
+// ulp[i] = ulp_distance<CoarseReal>(y_hi_acc[i], y_lo_acc[i]) for i < n.
+// For IEEE float and double the spacing is read off the exponent bits instead of calling nextafter,
+// which leaves a branch-light loop the compiler can vectorize; results are identical.
+template<class CoarseReal, class PreciseReal>
+void ulp_distances(PreciseReal const * y_hi_acc, PreciseReal const * y_lo_acc, CoarseReal* ulp, size_t n)
+{
+    if constexpr (std::is_same<CoarseReal, float>::value || std::is_same<CoarseReal, double>::value)
+    {
+        using std::abs;
+        using U = typename float_bits<CoarseReal>::type;
+        constexpr int mantissa_bits = std::numeric_limits<CoarseReal>::digits - 1;
+        constexpr U exponent_mask = (~U(0) >> 1) >> mantissa_bits;
+        for (size_t i = 0; i < n; ++i)
+        {
+            CoarseReal c = static_cast<CoarseReal>(abs(y_hi_acc[i]));
+            U u;
+            std::memcpy(&u, &c, sizeof(U));
+            U e = u >> mantissa_bits;
+            if (e == exponent_mask || c == std::numeric_limits<CoarseReal>::max())
+            {
+                // inf, nan, and max, where nextafter does not step up:
+                ulp[i] = ulp_distance<CoarseReal>(y_hi_acc[i], y_lo_acc[i]);
+                continue;
+            }
+            // The spacing above c is 2^(e - bias - mantissa_bits): a normal number if e > mantissa_bits, else subnormal.
+            U s = e > mantissa_bits ? (e - mantissa_bits) << mantissa_bits : (e == 0 ? U(1) : U(1) << (e - 1));
+            CoarseReal dist;
+            std::memcpy(&dist, &s, sizeof(U));
+            ulp[i] = static_cast<CoarseReal>((y_lo_acc[i] - y_hi_acc[i])/static_cast<PreciseReal>(dist));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            ulp[i] = ulp_distance<CoarseReal>(y_hi_acc[i], y_lo_acc[i]);
+        }
+    }
+}
+
+// Reduction of the ULP errors falling into one pixel column.
+template<class Real>
+struct ulp_column
+{
+    Real min = std::numeric_limits<Real>::max();
+    Real max = std::numeric_limits<Real>::lowest();
+    size_t count = 0;
+
+    void add(Real ulp)
+    {
+        if (ulp < min)
+        {
+            min = ulp;
+        }
+        if (ulp > max)
+        {
+            max = ulp;
+        }
+        ++count;
+    }
+
+    void merge(ulp_column const & other)
+    {
+        if (other.min < min)
+        {
+            min = other.min;
+        }
+        if (other.max > max)
+        {
+            max = other.max;
+        }
+        count += other.count;
+    }
+};
+
+// Writes everything up to the data: the svg header, title, axes and gridlines. Leaves the translated <g> open.
+template<class CoarseReal, class PreciseReal, class F1, class F2>
+void write_ulp_frame(std::ostream& fs, ulp_layout const & layout, std::string const & title,
+                     F1 x_scale, F2 y_scale, CoarseReal a, CoarseReal b,
+                     PreciseReal min_y, PreciseReal max_y, PreciseReal worst_ulp_distance,
+                     int horizontal_lines, int vertical_lines)
+{
+    using std::floor;
+    int const width = layout.width;
+    int const height = layout.height;
+    int const margin_top = layout.margin_top;
+    int const margin_left = layout.margin_left;
+    int const graph_width = layout.graph_width;
+    int const graph_height = layout.graph_height;
+    fs << "<?xml version=\"1.0\" encoding='UTF-8' ?>\n"
+       << "<svg xmlns='http://www.w3.org/2000/svg' width='"
+       << width << "' height='"
+       << height << "'>\n"
+       << "<style>svg { background-color: black; }\n"
+       << "</style>\n";
+    if (title.size() > 0)
+    {
+        fs << "<text x='" << floor(width/2)
+           << "' y='" << floor(margin_top/2)
+           << "' font-family='Palatino' font-size='25' fill='white'  alignment-baseline='middle' text-anchor='middle'>"
+           << title
+           << "</text>\n";
+    }
+
+    // Construct SVG group to simplify the calculations slightly:
+    fs << "<g transform='translate(" << margin_left << ", " << margin_top << ")'>\n";
+        // y-axis:
+    fs  << "<line x1='0' y1='0' x2='0' y2='" << graph_height
+        << "' stroke='gray' stroke-width='1'/>\n";
+    PreciseReal x_axis_loc = y_scale(static_cast<PreciseReal>(0));
+    fs << "<line x1='0' y1='" << coordinate(x_axis_loc)
+        << "' x2='" << graph_width << "' y2='" << coordinate(x_axis_loc)
+        << "' stroke='gray' stroke-width='1'/>\n";
+
+    if (worst_ulp_distance > 3)
+    {
+        detail::write_gridlines(fs, horizontal_lines, vertical_lines, x_scale, y_scale, a, b,
+                                static_cast<CoarseReal>(min_y), static_cast<CoarseReal>(max_y), graph_width, graph_height, margin_left);
+    }
+    else
+    {
+        std::vector<double> ys{-3.0, -2.5, -2.0, -1.5, -1.0, -0.5, 0.5, 1.0, 1.5, 2.0, 2.5, 3.0};
+        for (size_t i = 0; i < ys.size(); ++i)
+        {
+            if (min_y <= ys[i] && ys[i] <= max_y)
+            {
+                PreciseReal y_cord_dataspace = ys[i];
+                PreciseReal y = y_scale(y_cord_dataspace);
+                fs << "<line x1='0' y1='" << coordinate(y) << "' x2='" << graph_width
+                   << "' y2='" << coordinate(y)
+                   << "' stroke='gray' stroke-width='1' opacity='0.5' stroke-dasharray='4' />\n";
+
+                fs << "<text x='" <<  -margin_left/2 << "' y='" << coordinate(y - 3)
+                   << "' font-family='times' font-size='10' fill='white' transform='rotate(-90 "
+                   << -margin_left/2 + 11 << " " << coordinate(y + 5) << ")'>"
+                   <<  std::setprecision(4) << y_cord_dataspace << "</text>\n";
+            }
+        }
+        for (int i = 1; i <= vertical_lines; ++i)
+        {
+            CoarseReal x_cord_dataspace = a +  ((b - a)*i)/vertical_lines;
+            CoarseReal x = x_scale(x_cord_dataspace);
+            fs << "<line x1='" << coordinate(x) << "' y1='0' x2='" << coordinate(x)
+               << "' y2='" << graph_height
+               << "' stroke='gray' stroke-width='1' opacity='0.5' stroke-dasharray='4' />\n";
+
+            fs << "<text x='" <<  coordinate(x - 10)  << "' y='" << graph_height + 10
+               << "' font-family='times' font-size='10' fill='white'>"
+               << std::setprecision(4) << x_cord_dataspace << "</text>\n";
+        }
+    }
+}
+
+// Draws each non-empty column as a vertical bar spanning its [min, max], or as a dot if the column holds a single value.
+template<class CoarseReal, class F1, class F2>
+void write_ulp_columns(std::ostream & fs, std::vector<ulp_column<CoarseReal>> const & columns, std::vector<CoarseReal> const & abscissas,
+                       int clip, std::string const & color, F1 x_scale, F2 y_scale)
+{
+    for (size_t j = 0; j < columns.size(); ++j)
+    {
+        auto const & column = columns[j];
+        if (column.count == 0)
+        {
+            continue;
+        }
+        CoarseReal lo = column.min;
+        CoarseReal hi = column.max;
+        if (clip > 0)
+        {
+            if (lo > clip || hi < -clip)
+            {
+                continue;
+            }
+            if (lo < -clip)
+            {
+                lo = -clip;
+            }
+            if (hi > clip)
+            {
+                hi = clip;
+            }
+        }
+        auto x = x_scale(abscissas[j]);
+        if (lo == hi)
+        {
+            fs << "<circle cx='" << coordinate(x) << "' cy='" << coordinate(y_scale(lo)) << "' r='1' fill='" << color << "'/>";
+        }
+        else
+        {
+            fs << "<line x1='" << coordinate(x) << "' y1='" << coordinate(y_scale(hi)) << "' x2='" << coordinate(x) << "' y2='" << coordinate(y_scale(lo))
+               << "' stroke='" << color << "' stroke-width='2' stroke-linecap='round'/>";
+        }
+    }
+}
+
+// Screen-space aggregation of a point cloud: a count per (1px column, cell_height rows) cell, plus the vertical extent of each column.
+// Used instead of one <circle> per sample, so the output size depends on the plot size rather than on the number of samples.
+class ulp_density {
+public:
+    ulp_density(int graph_width, int graph_height, int cell_height = 2) :
+        columns_(graph_width + 1),
+        rows_(graph_height/cell_height + 1),
+        cell_height_{cell_height},
+        counts_(columns_*rows_, 0),
+        extent_(columns_, ulp_column<double>())
+    {
+    }
+
+    void add(double x, double y)
+    {
+        long col = std::lround(x);
+        long row = std::lround(y/cell_height_);
+        if (col < 0 || col >= static_cast<long>(columns_) || row < 0 || row >= static_cast<long>(rows_))
+        {
+            return;
+        }
+        ++counts_[col*rows_ + row];
+        extent_[col].add(y);
+    }
+
+    // Cells are shaded by log(count) in a few discrete levels, so a single sample is still visible next to a dense column.
+    // Each level is one <path> of vertical runs, and the min/max bars are one more path underneath.
+    void write(std::ostream & fs, std::string const & color) const
+    {
+        using std::log;
+        uint32_t max_count = 0;
+        for (auto c : counts_)
+        {
+            max_count = std::max(max_count, c);
+        }
+        if (max_count == 0)
+        {
+            return;
+        }
+
+        fs << "<path d='";
+        for (size_t col = 0; col < columns_; ++col)
+        {
+            auto const & e = extent_[col];
+            long top = std::lround(e.min);
+            long bottom = std::lround(e.max);
+            if (e.count > 0 && bottom > top)
+            {
+                fs << "M" << col << " " << top << "V" << bottom;
+            }
+        }
+        fs << "' stroke='" << color << "' stroke-width='1' stroke-opacity='0.35' fill='none'/>\n";
+
+        constexpr int levels = 4;
+        double log_max = log(1.0 + max_count);
+        std::vector<unsigned char> level(counts_.size(), 0);
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            if (counts_[i] > 0)
+            {
+                int l = static_cast<int>(std::ceil(levels*log(1.0 + counts_[i])/log_max));
+                level[i] = static_cast<unsigned char>(std::min(std::max(l, 1), levels));
+            }
+        }
+        for (int l = 1; l <= levels; ++l)
+        {
+            fs << "<path d='";
+            for (size_t col = 0; col < columns_; ++col)
+            {
+                size_t row = 0;
+                while (row < rows_)
+                {
+                    if (level[col*rows_ + row] != l)
+                    {
+                        ++row;
+                        continue;
+                    }
+                    size_t run = row;
+                    while (run < rows_ && level[col*rows_ + run] == l)
+                    {
+                        ++run;
+                    }
+                    fs << "M" << col << " " << static_cast<long>(row*cell_height_) - cell_height_/2
+                       << "v" << (run - row)*cell_height_;
+                    row = run;
+                }
+            }
+            fs << "' stroke='" << color << "' stroke-width='2' stroke-opacity='" << (l == levels ? "1" : l == 3 ? "0.8" : l == 2 ? "0.6" : "0.4")
+               << "' fill='none'/>\n";
+        }
+    }
+
+private:
+    size_t columns_;
+    size_t rows_;
+    int cell_height_;
+    std::vector<uint32_t> counts_;
+    std::vector<ulp_column<double>> extent_;
+};
+
+// Draws the condition number envelope +-cond(x) as paths, breaking them wherever cond is nan or exceeds the clip.
+// quantum > 0 writes the paths in the compact relative encoding of write_path_points.
+template<class CoarseReal, class PreciseReal, class F1, class F2>
+void write_ulp_envelope(std::ostream & fs, std::vector<CoarseReal> const & abscissas, std::vector<PreciseReal> const & cond,
+                        int clip, std::string const & color, F1 x_scale, F2 y_scale, double quantum = 0)
+{
+    using std::isnan;
+    std::string close_path = "' stroke='"  + color + "' stroke-width='1' fill='none'></path>\n";
+    std::vector<PreciseReal> t;
+    std::vector<PreciseReal> y;
+    auto flush = [&]()
+    {
+        fs << "<path d='";
+        write_path_points(fs, t, y, t.size(), 0, quantum);
+        fs << close_path;
+    };
+    size_t jstart = 0;
+    if (clip > 0)
+    {
+        while (cond[jstart] > clip)
+        {
+            ++jstart;
+            if (jstart >= cond.size())
+            {
+                return;
+            }
+        }
+    }
+    size_t jmin = jstart;
+new_top_path:
+    if (jmin >= cond.size())
+    {
+        goto start_bottom_paths;
+    }
+    t.assign(1, x_scale(abscissas[jmin]));
+    y.assign(1, y_scale(cond[jmin]));
+
+    for (size_t j = jmin + 1; j < abscissas.size(); ++j)
+    {
+        bool bad = isnan(cond[j]) || (clip > 0 && cond[j] > clip);
+        if (bad)
+        {
+            ++j;
+            while ( (j < abscissas.size() - 2) && bad)
+            {
+                bad = isnan(cond[j]) || (clip > 0 && cond[j] > clip);
+                ++j;
+            }
+            jmin = j;
+            flush();
+            goto new_top_path;
+        }
+
+        t.push_back(x_scale(abscissas[j]));
+        y.push_back(y_scale(cond[j]));
+    }
+    flush();
+start_bottom_paths:
+    jmin = jstart;
+new_bottom_path:
+    if (jmin >= cond.size())
+    {
+        return;
+    }
+    t.assign(1, x_scale(abscissas[jmin]));
+    y.assign(1, y_scale(-cond[jmin]));
+
+    for (size_t j = jmin + 1; j < abscissas.size(); ++j)
+    {
+        bool bad = isnan(cond[j]) || (clip > 0 && cond[j] > clip);
+        if (bad)
+        {
+            ++j;
+            while ( (j < abscissas.size() - 2) && bad)
+            {
+                bad = isnan(cond[j]) || (clip > 0 && cond[j] > clip);
+                ++j;
+            }
+            jmin = j;
+            flush();
+            goto new_bottom_path;
+        }
+        t.push_back(x_scale(abscissas[j]));
+        y.push_back(y_scale(-cond[j]));
+    }
+    flush();
+}
+
+}}
+#endif
@@ -0,0 +1,316 @@
+#ifndef QUICKSVG_EXHAUSTIVE_ULP_PLOT_HPP
+#define QUICKSVG_EXHAUSTIVE_ULP_PLOT_HPP
+#include "detail/float_bits.hpp"
+#include "detail/parallel.hpp"
+#include "detail/svg_document.hpp"
+#include "detail/ulp_svg.hpp"
+#include "ulp_stats.hpp"
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/math/tools/condition_numbers.hpp>
+
+// Like ulp_plot, but instead of sampling [a, b] at random, every representable CoarseReal in [a, b] is tested.
+// For CoarseReal = float this is at most 2^32 evaluations, so the errors are never stored:
+// they are reduced on the fly into one min/max/count bin per pixel column, and memory is O(width).
+
+namespace quicksvg {
+
+template<class F, typename PreciseReal, typename CoarseReal>
+class exhaustive_ulp_plot {
+public:
+    exhaustive_ulp_plot(F hi_acc_impl, CoarseReal a, CoarseReal b, int width = 1100, unsigned threads = 0) :
+        hi_acc_impl_{hi_acc_impl},
+        a_{a},
+        b_{b},
+        threads_{threads},
+        clip_{-1},
+        width_{width},
+        coordinate_decimals_{detail::default_coordinate_decimals},
+        path_quantum_{0},
+        gzip_{false},
+        envelope_color_{"chartreuse"}
+    {
+        static_assert(sizeof(PreciseReal) >= sizeof(CoarseReal), "PreciseReal must have larger size than CoarseReal");
+        if (b <= a)
+        {
+            throw std::domain_error("On interval [a,b], b > a is required.");
+        }
+        // One column per pixel of the graph. The title is not known until write(), so the columns are sized for the
+        // wider, untitled graph, and write() merges neighbours when a title makes the graph narrower.
+        int graph_width = detail::make_ulp_layout(width, false).graph_width;
+        if (graph_width <= 1)
+        {
+            throw std::domain_error("Width = " + std::to_string(width) + ", which is too small.");
+        }
+
+        size_t columns = graph_width;
+        column_abscissas_ = column_centres(columns);
+
+        // The envelope is smooth, so one condition number per column is plenty:
+        cond_.resize(columns, std::numeric_limits<PreciseReal>::quiet_NaN());
+        detail::parallel_for(columns, threads_, [&](size_t i)
+        {
+            PreciseReal x = column_abscissas_[i];
+            if (hi_acc_impl_(x) != 0)
+            {
+                cond_[i] = boost::math::tools::evaluation_condition_number(hi_acc_impl_, x);
+                if (cond_[i] < 0.5)
+                {
+                    cond_[i] = 0.5;
+                }
+            }
+        });
+    }
+
+    void set_clip(int clip)
+    {
+        clip_ = clip;
+    }
+
+    void set_envelope_color(std::string const & color)
+    {
+        envelope_color_ = color;
+    }
+
+    // Write envelope paths as relative l/h/v steps on a grid of quantum_px pixels, with duplicate points dropped.
+    // Typically 2-4x smaller than the default absolute coordinates.
+    void set_compact_paths(bool compact, double quantum_px = 0.1)
+    {
+        if (compact && !(quantum_px > 0))
+        {
+            throw std::domain_error("The path quantum must be positive; requested " + std::to_string(quantum_px));
+        }
+        path_quantum_ = compact ? quantum_px : 0;
+    }
+
+    // Write gzip-compressed SVG, as is always done for .svgz and .svg.gz filenames. Requires QUICKSVG_HAS_ZLIB.
+    void set_gzip(bool gzip)
+    {
+        gzip_ = detail::checked_gzip(gzip);
+    }
+
+    // Decimals written for screen coordinates; the default, 2, is 0.01px.
+    void set_coordinate_decimals(int decimals)
+    {
+        coordinate_decimals_ = detail::checked_coordinate_decimals(decimals);
+    }
+
+    // Number of representable values in [a, b], i.e., the number of evaluations per function.
+    size_t abscissa_count() const
+    {
+        return static_cast<size_t>(detail::to_ordered(b_) - detail::to_ordered(a_)) + 1;
+    }
+
+    template<class G>
+    void add_fn(G g, std::string const & color = "steelblue")
+    {
+        using std::abs;
+        using std::isnan;
+        using std::signbit;
+        using U = typename detail::float_bits<CoarseReal>::type;
+        U first = detail::to_ordered(a_);
+        size_t n = abscissa_count();
+        size_t columns = column_abscissas_.size();
+        unsigned threads = detail::thread_count(n, threads_);
+
+        std::vector<std::vector<detail::ulp_column<CoarseReal>>> partial(threads, std::vector<detail::ulp_column<CoarseReal>>(columns));
+        std::vector<ulp_stats<CoarseReal>> stats(threads);
+        detail::parallel_blocks(n, threads, [&](unsigned t, size_t begin, size_t end)
+        {
+            auto & bins = partial[t];
+            auto & st = stats[t];
+            for (size_t k = begin; k < end; ++k)
+            {
+                CoarseReal x = detail::from_ordered<CoarseReal>(first + static_cast<U>(k));
+                if (x == 0 && signbit(x))
+                {
+                    // +0 is visited as well.
+                    continue;
+                }
+                PreciseReal y_hi_acc = hi_acc_impl_(static_cast<PreciseReal>(x));
+                PreciseReal y_lo_acc = g(x);
+                CoarseReal ulp = detail::ulp_distance<CoarseReal>(y_hi_acc, y_lo_acc);
+                st.add(x, ulp);
+                if (!isnan(ulp))
+                {
+                    bins[column(x)].add(ulp);
+                }
+            }
+        });
+
+        // Merge in block order, so ties go to the smallest abscissa whatever the thread count:
+        for (unsigned t = 1; t < threads; ++t)
+        {
+            for (size_t i = 0; i < columns; ++i)
+            {
+                partial[0][i].merge(partial[t][i]);
+            }
+            stats[0].merge(stats[t]);
+        }
+        columns_.emplace_back(std::move(partial[0]));
+        stats_.emplace_back(stats[0]);
+        colors_.emplace_back(color);
+    }
+
+    // The input with the largest |ULP error| for the i-th function added.
+    ulp_worst_case<CoarseReal> worst_case(size_t i = 0) const
+    {
+        return ulp_worst_case<CoarseReal>{stats_.at(i).worst_abscissa, stats_.at(i).worst};
+    }
+
+    ulp_stats<CoarseReal> const & stats(size_t i = 0) const
+    {
+        return stats_.at(i);
+    }
+
+    void write(std::string const & filename, bool ulp_envelope = true, std::string const & title = "",
+               int horizontal_lines = 8, int vertical_lines = 10)
+    {
+        using std::abs;
+        if (columns_.size() == 0)
+        {
+            throw std::domain_error("No functions added for comparison.");
+        }
+
+        PreciseReal worst_ulp_distance = 0;
+        PreciseReal min_y = std::numeric_limits<PreciseReal>::max();
+        PreciseReal max_y = std::numeric_limits<PreciseReal>::lowest();
+        for (auto const & st : stats_)
+        {
+            if (abs(st.worst) > worst_ulp_distance)
+            {
+                worst_ulp_distance = abs(st.worst);
+            }
+            if (st.min < min_y)
+            {
+                min_y = st.min;
+            }
+            if (st.max > max_y)
+            {
+                max_y = st.max;
+            }
+        }
+
+        if (clip_ > 0)
+        {
+            if (max_y > clip_)
+            {
+                max_y = clip_;
+            }
+            if (min_y < -clip_)
+            {
+                min_y = -clip_;
+            }
+        }
+
+        detail::ulp_layout layout = detail::make_ulp_layout(width_, title.size() > 0);
+        int graph_height = layout.graph_height;
+        int graph_width = layout.graph_width;
+        if (graph_width <= 1)
+        {
+            throw std::domain_error("Width = " + std::to_string(width_) + ", which is too small for a title.");
+        }
+        // Columns narrower than a pixel would overlap, so they are merged into the pixel columns of this layout:
+        std::vector<CoarseReal> pixel_abscissas;
+        if (static_cast<size_t>(graph_width) < column_abscissas_.size())
+        {
+            pixel_abscissas = column_centres(graph_width);
+        }
+
+        // Maps [a,b] to [0, graph_width]
+        auto x_scale = [&](CoarseReal x)->CoarseReal
+        {
+            return ((x-a_)/(b_ - a_))*static_cast<CoarseReal>(graph_width);
+        };
+
+        auto y_scale = [&](PreciseReal y)->PreciseReal
+        {
+            return ((max_y - y)/(max_y - min_y) )*static_cast<PreciseReal>(graph_height);
+        };
+
+        detail::svg_document fs;
+        if (gzip_ || detail::is_gzip_filename(filename))
+        {
+            fs.start_gzip();
+        }
+        // About 100 bytes per column bar, and 16 per envelope point on each side:
+        fs.reserve(4096 + 100*column_abscissas_.size()*columns_.size() + (ulp_envelope ? 32*column_abscissas_.size() : 0));
+        fs << detail::coordinate_decimals{coordinate_decimals_};
+        detail::write_ulp_frame(fs, layout, title, x_scale, y_scale, a_, b_, min_y, max_y, worst_ulp_distance,
+                                horizontal_lines, vertical_lines);
+
+        for (size_t i = 0; i < columns_.size(); ++i)
+        {
+            if (pixel_abscissas.empty())
+            {
+                detail::write_ulp_columns(fs, columns_[i], column_abscissas_, clip_, colors_[i], x_scale, y_scale);
+            }
+            else
+            {
+                detail::write_ulp_columns(fs, merge_columns(columns_[i], pixel_abscissas.size()), pixel_abscissas, clip_, colors_[i],
+                                          x_scale, y_scale);
+            }
+        }
+
+        if (ulp_envelope)
+        {
+            detail::write_ulp_envelope(fs, column_abscissas_, cond_, clip_, envelope_color_, x_scale, y_scale, path_quantum_);
+        }
+        fs << "</g>\n"
+           << "</svg>\n";
+        fs.commit(filename);
+    }
+
+private:
+    // The midpoints of `columns` equal slices of [a, b].
+    std::vector<CoarseReal> column_centres(size_t columns) const
+    {
+        std::vector<CoarseReal> centres(columns);
+        for (size_t i = 0; i < columns; ++i)
+        {
+            PreciseReal x = a_ + (PreciseReal(b_) - PreciseReal(a_))*(2*i + 1)/(2*columns);
+            centres[i] = static_cast<CoarseReal>(x);
+        }
+        return centres;
+    }
+
+    // Each column goes to the one of `pixels` fewer columns that contains its midpoint.
+    static std::vector<detail::ulp_column<CoarseReal>> merge_columns(std::vector<detail::ulp_column<CoarseReal>> const & columns, size_t pixels)
+    {
+        std::vector<detail::ulp_column<CoarseReal>> merged(pixels);
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            merged[(2*i + 1)*pixels/(2*columns.size())].merge(columns[i]);
+        }
+        return merged;
+    }
+
+    size_t column(CoarseReal x) const
+    {
+        size_t columns = column_abscissas_.size();
+        double t = (static_cast<double>(x) - static_cast<double>(a_))/(static_cast<double>(b_) - static_cast<double>(a_));
+        size_t i = static_cast<size_t>(t*columns);
+        return i < columns ? i : columns - 1;
+    }
+
+    F hi_acc_impl_;
+    CoarseReal a_;
+    CoarseReal b_;
+    unsigned threads_;
+    int clip_;
+    int width_;
+    int coordinate_decimals_;
+    double path_quantum_;
+    bool gzip_;
+    std::string envelope_color_;
+    std::vector<CoarseReal> column_abscissas_;
+    std::vector<PreciseReal> cond_;
+    std::vector<std::vector<detail::ulp_column<CoarseReal>>> columns_;
+    std::vector<ulp_stats<CoarseReal>> stats_;
+    std::vector<std::string> colors_;
+};
+
+} // namespace quicksvg
+#endif
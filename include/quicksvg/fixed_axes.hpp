@@ -0,0 +1,27 @@
+#ifndef QUICKSVG_FIXED_AXES_HPP
+#define QUICKSVG_FIXED_AXES_HPP
+#include <stdexcept>
+
+namespace quicksvg {
+
+// Axis ranges known before any data arrives. Plots constructed with them write each dataset as it is added,
+// instead of holding every dataset until write_all() to find the data range.
+template<class Real>
+struct fixed_axes
+{
+    Real x_min;
+    Real x_max;
+    Real y_min;
+    Real y_max;
+
+    void check() const
+    {
+        if (!(x_min < x_max) || !(y_min < y_max))
+        {
+            throw std::domain_error("Fixed axes need x_min < x_max and y_min < y_max.");
+        }
+    }
+};
+
+} // namespace quicksvg
+#endif
@@ -1,12 +1,19 @@
 #ifndef QUICKSVG_GRAPH_FN_HPP
 #define QUICKSVG_GRAPH_FN_HPP
 #include "detail/generic_svg_functionality.hpp"
+#include "detail/batch.hpp"
+#include "detail/parallel.hpp"
+#include "detail/path.hpp"
+#include "detail/svg_document.hpp"
+#include "fixed_axes.hpp"
+#include <algorithm>
 #include <iomanip>
+#include <queue>
 #include <cassert>
 #include <vector>
 #include <utility>
-#include <fstream>
 #include <iostream>
+#include <sstream>
 
 namespace quicksvg {
 
@@ -18,12 +25,22 @@ public:
              m_min_x{x_min},
              m_max_x{x_max},
              m_samples{samples},
+             m_filename{filename},
              m_is_written{false},
              m_stroke_width{1},
              m_horizontal_lines{8},
-             m_vertical_lines{10}
+             m_vertical_lines{10},
+             m_threads{1},
+             m_adaptive_budget{0},
+             m_adaptive_tolerance{0.25},
+             m_decimation_threshold{detail::default_decimation_threshold},
+             m_decimation_tolerance{0},
+             m_coordinate_decimals{detail::default_coordinate_decimals},
+             m_path_quantum{0},
+             m_gzip{detail::checked_gzip(detail::is_gzip_filename(filename))},
+             m_streaming{false},
+             m_frame_written{false}
     {
-        m_fs.open(filename);
         assert(m_max_x > m_min_x);
         if (samples < 10)
         {
@@ -54,17 +71,77 @@ public:
         detail::write_prelude(m_fs, title, width, height, m_margin_top);
     }
 
+    // Streaming: with the y range fixed up front, each function is written as soon as it is added. It is evaluated a chunk
+    // at a time and, past the decimation threshold, only the first, last, lowest and highest point of each pixel column
+    // is kept, so samples can far exceed memory. Values outside [y_min, y_max] run off the graph.
+    graph_fn(fixed_axes<Real> const & axes, std::string const & title, std::string const & filename,
+             unsigned samples = 100, int width = 1100) :
+             graph_fn(axes.x_min, axes.x_max, title, filename, samples, width)
+    {
+        axes.check();
+        m_min_y = axes.y_min;
+        m_max_y = axes.y_max;
+        m_streaming = true;
+    }
+
     void set_stroke_width(int sw)
     {
         m_stroke_width = sw;
     }
 
+    // Adaptive sampling: after the uniform grid of `samples` points, keep bisecting the intervals whose midpoint is
+    // furthest (in pixels) from the straight line drawn between the endpoints, until every midpoint is within
+    // tolerance_px or the function has been evaluated max_evaluations times. max_evaluations <= samples turns it off.
+    void set_adaptive(unsigned max_evaluations, double tolerance_px = 0.25)
+    {
+        m_adaptive_budget = max_evaluations;
+        m_adaptive_tolerance = tolerance_px;
+    }
+
+    // Paths with more than max_points points are reduced to the first, last, lowest and highest point of each pixel column,
+    // and then, if tolerance_px > 0, simplified with Douglas-Peucker to within tolerance_px pixels.
+    void set_decimation(size_t max_points, double tolerance_px = 0)
+    {
+        m_decimation_threshold = max_points;
+        m_decimation_tolerance = tolerance_px;
+    }
+
+    // Decimals written for screen coordinates; the default, 2, is 0.01px.
+    void set_coordinate_decimals(int decimals)
+    {
+        m_coordinate_decimals = detail::checked_coordinate_decimals(decimals);
+    }
+
+    // Write paths as relative l/h/v steps on a grid of quantum_px pixels, with duplicate points dropped.
+    // Typically 2-4x smaller than the default absolute coordinates.
+    void set_compact_paths(bool compact, double quantum_px = 0.1)
+    {
+        if (compact && !(quantum_px > 0))
+        {
+            throw std::domain_error("The path quantum must be positive; requested " + std::to_string(quantum_px));
+        }
+        m_path_quantum = compact ? quantum_px : 0;
+    }
+
+    // Write gzip-compressed SVG. On by default for .svgz and .svg.gz filenames. Requires QUICKSVG_HAS_ZLIB.
+    void set_gzip(bool gzip)
+    {
+        m_gzip = detail::checked_gzip(gzip);
+    }
+
+    // Evaluate added functions on this many threads (0 = every core). f must then be safe to call concurrently.
+    void set_threads(unsigned threads)
+    {
+        m_threads = threads;
+    }
+
     void set_gridlines(int horizonal_lines, int vertical_lines)
     {
         m_horizontal_lines = horizonal_lines;
         m_vertical_lines = vertical_lines;
     }
 
+    // f is either y = f(x), or a batch callable f(x, y, n) writing y[i] = f(x[i]) for i < n, which is called in chunks.
     template<class F>
     void add_fn(F f, std::string const & color="steelblue")
     {
@@ -73,41 +150,33 @@ public:
             throw std::logic_error("Cannot add data to graph after writing it.\n");
         }
 
-        std::vector<Real> v(m_samples);
-        for(size_t i = 0; i < v.size(); ++i)
+        if (m_streaming)
         {
-            Real step = (m_max_x - m_min_x)/(m_samples - static_cast<Real>(1));
-            Real x = m_min_x + step*i;
-            v[i] = f(x);
+            stream_fn(f, color);
+            return;
+        }
 
-            using std::isnan;
-            if (isnan(v[i]))
-            {
-                // This throw leaves a partially written file on disk.
-                // The class should instead write the whole thing to an ostringstream, and then write the result to disk.
-                std::ostringstream oss;
-                oss << "Evaluating your function at x = " << x << " returned a NaN; which cannot be graphed.\n";
-                throw std::domain_error(oss.str());
-            }
+        Real step = (m_max_x - m_min_x)/(m_samples - static_cast<Real>(1));
+        std::vector<Real> v(m_samples);
+        evaluate(f, step, 0, v, m_min_y, m_max_y);
 
-            if (v[i] > m_max_y)
-            {
-                m_max_y = v[i];
-            }
-            if (v[i] < m_min_y)
+        std::vector<Real> x;
+        if (m_adaptive_budget > v.size())
+        {
+            x.resize(v.size());
+            for (size_t i = 0; i < x.size(); ++i)
             {
-                m_min_y = v[i];
+                x[i] = m_min_x + step*i;
             }
+            refine(f, x, v);
         }
-
+        m_abscissas.emplace_back(std::move(x));
         m_dataset.emplace_back(v);
         m_connect_color.emplace_back(color);
     }
 
     void write_all()
     {
-
-      // Maps [a,b] to [0, graph_width]
       if (m_max_y == m_min_y)
       {
           throw std::logic_error("The data minimum and maximum are the same. The resulting graph will have zero height.\n");
@@ -118,60 +187,47 @@ public:
           throw std::logic_error("The data max is less than the data minimum. Did you add data to the graph?\n");
       }
 
-      auto x_scale = [this](Real x)->Real
+      size_t bytes = 4096;
+      for (auto const & v : m_dataset)
       {
-          return ((x-m_min_x)/(m_max_x - m_min_x))*static_cast<Real>(m_graph_width);
-      };
-
-      auto y_scale = [this](Real y)->Real
-      {
-          return ((m_max_y - y)/(m_max_y - m_min_y))*static_cast<Real>(m_graph_height);
-      };
-
-        // Construct SVG group to simplify the calculations slightly:
-      m_fs << "<g transform='translate(" << m_margin_left << ", " << m_margin_top << ")'>\n";
-           // y-axis:
-      m_fs  << "<line x1='0' y1='0' x2='0' y2='" << m_graph_height
-            << "' stroke='gray' stroke-width='1' />\n";
-      // x-axis: If 0 is between the min a max height, place the axis at zero.
-      // Otherwise, place is at the bottom of the graph.
-      Real x_axis_loc = m_graph_height;
-      if (m_min_y <= 0 && m_max_y >= 0)
+          bytes += 128 + 16*v.size();
+      }
+      if (m_gzip)
       {
-          x_axis_loc = y_scale(0);
+          m_fs.start_gzip();
       }
-      m_fs << "<line x1='0' y1='" << x_axis_loc
-           << "' x2='" << m_graph_width << "' y2='" << x_axis_loc
-           << "' stroke='gray' stroke-width='1' />\n";
-
-      detail::write_gridlines(m_fs, m_horizontal_lines, m_vertical_lines, x_scale, y_scale, m_min_x, m_max_x,
-                              m_min_y, m_max_y, m_graph_width, m_graph_height, m_margin_left);
-
+      m_fs.reserve(bytes);
+      write_frame();
 
       Real step = (m_max_x - m_min_x)/(m_samples - 1.0);
       for (size_t i = 0; i < m_dataset.size(); ++i)
       {
           auto const & v = m_dataset[i];
+          auto const & x = m_abscissas[i];
           std::string const & stroke = m_connect_color[i];
 
-          m_fs << "<path d='M" << x_scale(m_min_x) << " " << y_scale(v[0]);
+          std::vector<Real> t(v.size());
+          std::vector<Real> y(v.size());
+          t[0] = x_scale(m_min_x);
+          y[0] = y_scale(v[0]);
           for (size_t j = 1; j < v.size(); ++j)
           {
-              Real t = x_scale(m_min_x + j*step);
-              Real y = y_scale(v[j]);
+              t[j] = x.empty() ? x_scale(m_min_x + j*step) : x_scale(x[j]);
+              y[j] = y_scale(v[j]);
               using std::isnan;
-              if (isnan(y))
+              if (isnan(y[j]))
               {
                   throw std::domain_error("The domain rescaled data is a nan!");
               }
-              m_fs << " L" << t << " " << y;
           }
+          m_fs << "<path d='";
+          detail::write_path_points(m_fs, t, y, m_decimation_threshold, m_decimation_tolerance, m_path_quantum);
           m_fs << "' stroke='" << stroke << "' stroke-width='" << m_stroke_width << "' fill='none'></path>\n";
       }
 
       m_fs << "</g>\n"
          << "</svg>\n";
-      m_fs.close();
+      m_fs.commit(m_filename);
 
       m_is_written = true;
     }
@@ -180,19 +236,272 @@ public:
     {
         if (!m_is_written)
         {
-            this->write_all();
+            // An exception escaping a destructor would terminate the program:
+            try
+            {
+                this->write_all();
+            }
+            catch (std::exception const & e)
+            {
+                std::cerr << "Warning: " << m_filename << " was not written: " << e.what() << "\n";
+            }
         }
     }
 
 private:
+    // Maps [a,b] to [0, graph_width]
+    Real x_scale(Real x) const
+    {
+        return ((x-m_min_x)/(m_max_x - m_min_x))*static_cast<Real>(m_graph_width);
+    }
+
+    Real y_scale(Real y) const
+    {
+        return ((m_max_y - y)/(m_max_y - m_min_y))*static_cast<Real>(m_graph_height);
+    }
+
+    // The axes and gridlines, written once, as soon as the ranges are known.
+    void write_frame()
+    {
+        if (m_frame_written)
+        {
+            return;
+        }
+        m_frame_written = true;
+        if (m_gzip)
+        {
+            m_fs.start_gzip();
+        }
+        m_fs << detail::coordinate_decimals{m_coordinate_decimals};
+          // Construct SVG group to simplify the calculations slightly:
+        m_fs << "<g transform='translate(" << m_margin_left << ", " << m_margin_top << ")'>\n";
+             // y-axis:
+        m_fs  << "<line x1='0' y1='0' x2='0' y2='" << m_graph_height
+              << "' stroke='gray' stroke-width='1' />\n";
+        // x-axis: If 0 is between the min a max height, place the axis at zero.
+        // Otherwise, place is at the bottom of the graph.
+        Real x_axis_loc = m_graph_height;
+        if (m_min_y <= 0 && m_max_y >= 0)
+        {
+            x_axis_loc = y_scale(0);
+        }
+        m_fs << "<line x1='0' y1='" << detail::coordinate(x_axis_loc)
+             << "' x2='" << m_graph_width << "' y2='" << detail::coordinate(x_axis_loc)
+             << "' stroke='gray' stroke-width='1' />\n";
+
+        detail::write_gridlines(m_fs, m_horizontal_lines, m_vertical_lines, [this](Real x) { return x_scale(x); },
+                                [this](Real y) { return y_scale(y); }, m_min_x, m_max_x,
+                                m_min_y, m_max_y, m_graph_width, m_graph_height, m_margin_left);
+    }
+
+    // v[i] = f(x_min + step*(offset + i)) on m_threads threads, widening [lo, hi] to cover v. Throws on the first NaN.
+    template<class F>
+    void evaluate(F & f, Real step, size_t offset, std::vector<Real> & v, Real & lo, Real & hi)
+    {
+        using std::isnan;
+        unsigned threads = detail::thread_count(v.size(), m_threads);
+        std::vector<Real> min_y(threads, lo);
+        std::vector<Real> max_y(threads, hi);
+        std::vector<size_t> first_nan(threads, v.size());
+        detail::parallel_blocks(v.size(), threads, [&](unsigned t, size_t begin, size_t end)
+        {
+            if constexpr (detail::is_batch_callable<F, Real>::value)
+            {
+                std::vector<Real> x(std::min(end - begin, detail::batch_chunk_size));
+                for (size_t chunk = begin; chunk < end; chunk += x.size())
+                {
+                    size_t n = std::min(end - chunk, x.size());
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        x[i] = m_min_x + step*(offset + chunk + i);
+                    }
+                    f(x.data(), v.data() + chunk, n);
+                }
+            }
+            else
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    v[i] = f(m_min_x + step*(offset + i));
+                }
+            }
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (isnan(v[i]))
+                {
+                    first_nan[t] = i;
+                    return;
+                }
+                if (v[i] > max_y[t])
+                {
+                    max_y[t] = v[i];
+                }
+                if (v[i] < min_y[t])
+                {
+                    min_y[t] = v[i];
+                }
+            }
+        });
+
+        // Blocks are in order, so the first block with a NaN has the smallest offending x whatever the thread count:
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            if (first_nan[t] < v.size())
+            {
+                std::ostringstream oss;
+                oss << "Evaluating your function at x = " << m_min_x + step*(offset + first_nan[t]) << " returned a NaN; which cannot be graphed.\n";
+                throw std::domain_error(oss.str());
+            }
+        }
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            if (max_y[t] > hi)
+            {
+                hi = max_y[t];
+            }
+            if (min_y[t] < lo)
+            {
+                lo = min_y[t];
+            }
+        }
+    }
+
+    template<class F>
+    void stream_fn(F & f, std::string const & color)
+    {
+        if (m_adaptive_budget > m_samples)
+        {
+            throw std::logic_error("Adaptive sampling needs the final y range, so it cannot be combined with fixed axes.\n");
+        }
+        write_frame();
+        Real step = (m_max_x - m_min_x)/(m_samples - static_cast<Real>(1));
+        detail::m4_stream points(m_decimation_threshold);
+        std::vector<Real> v;
+        Real lo = m_min_y;
+        Real hi = m_max_y;
+        // Samples are evaluated, scaled and decimated this many at a time:
+        size_t const chunk = 1 << 16;
+        for (size_t begin = 0; begin < m_samples; begin += chunk)
+        {
+            v.resize(std::min(chunk, m_samples - begin));
+            evaluate(f, step, begin, v, lo, hi);
+            for (size_t i = 0; i < v.size(); ++i)
+            {
+                points.push(static_cast<double>(x_scale(m_min_x + (begin + i)*step)), static_cast<double>(y_scale(v[i])));
+            }
+        }
+        // Nothing is written until f has been evaluated everywhere, so a NaN leaves no partial path:
+        std::vector<double> t;
+        std::vector<double> y;
+        bool decimated = points.finish(t, y);
+        m_fs << "<path d='";
+        detail::write_path_points(m_fs, t, y, decimated ? 0 : m_decimation_threshold, m_decimation_tolerance, m_path_quantum);
+        m_fs << "' stroke='" << color << "' stroke-width='" << m_stroke_width << "' fill='none'></path>\n";
+    }
+
+    // Bisection driven by a max-heap of intervals keyed on the pixel distance of their midpoint from the chord.
+    // The y scale is taken from the data so far, since the final range is only known once every function is added.
+    template<class F>
+    void refine(F & f, std::vector<Real> & x, std::vector<Real> & y)
+    {
+        using std::abs;
+        using std::isnan;
+        struct interval
+        {
+            double deviation;
+            size_t left;
+            size_t right;
+            Real mid_x;
+            Real mid_y;
+            bool operator<(interval const & other) const
+            {
+                return deviation < other.deviation || (deviation == other.deviation && other.left < left);
+            }
+        };
+
+        double x_px = m_graph_width/static_cast<double>(m_max_x - m_min_x);
+        double y_px = m_max_y > m_min_y ? m_graph_height/static_cast<double>(m_max_y - m_min_y) : 0.0;
+        // Don't split below 1/16 pixel, else a jump would swallow the whole budget:
+        double min_width = 1/(16*x_px);
+        size_t evaluations = x.size();
+
+        std::priority_queue<interval> heap;
+        auto push = [&](size_t left, size_t right)
+        {
+            if (evaluations >= m_adaptive_budget || static_cast<double>(x[right] - x[left]) < 2*min_width)
+            {
+                return;
+            }
+            Real mid_x = x[left] + (x[right] - x[left])/2;
+            Real mid_y = detail::evaluate_at(f, mid_x);
+            ++evaluations;
+            if (isnan(mid_y))
+            {
+                std::ostringstream oss;
+                oss << "Evaluating your function at x = " << mid_x << " returned a NaN; which cannot be graphed.\n";
+                throw std::domain_error(oss.str());
+            }
+            double deviation = static_cast<double>(abs(mid_y - (y[left] + y[right])/2))*y_px;
+            heap.push(interval{deviation, left, right, mid_x, mid_y});
+        };
+
+        // New points are appended, and the neighbours of each point are tracked as indices until the final sort:
+        for (size_t i = 0; i + 1 < x.size(); ++i)
+        {
+            push(i, i + 1);
+        }
+        // Every midpoint evaluated is kept, whether or not its interval was split further:
+        while (!heap.empty())
+        {
+            interval top = heap.top();
+            heap.pop();
+            x.push_back(top.mid_x);
+            y.push_back(top.mid_y);
+            if (top.mid_y > m_max_y)
+            {
+                m_max_y = top.mid_y;
+            }
+            if (top.mid_y < m_min_y)
+            {
+                m_min_y = top.mid_y;
+            }
+            if (top.deviation > m_adaptive_tolerance)
+            {
+                size_t mid = x.size() - 1;
+                push(top.left, mid);
+                push(mid, top.right);
+            }
+        }
+
+        std::vector<size_t> order(x.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&x](size_t i, size_t j) { return x[i] < x[j]; });
+        std::vector<Real> sorted_x(x.size());
+        std::vector<Real> sorted_y(y.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            sorted_x[i] = x[order[i]];
+            sorted_y[i] = y[order[i]];
+        }
+        x = std::move(sorted_x);
+        y = std::move(sorted_y);
+    }
+
     Real m_min_x;
     Real m_max_x;
     unsigned m_samples;
-    std::ofstream m_fs;
+    std::string m_filename;
+    detail::svg_document m_fs;
     Real m_min_y;
     Real m_max_y;
     bool m_is_written;
     std::vector<std::vector<Real>> m_dataset;
+    // Empty for uniformly sampled data; the sample abscissas otherwise.
+    std::vector<std::vector<Real>> m_abscissas;
     std::vector<std::string> m_connect_color;
     int m_margin_top;
     int m_margin_left;
@@ -203,6 +512,16 @@ private:
     int m_stroke_width;
     int m_horizontal_lines;
     int m_vertical_lines;
+    unsigned m_threads;
+    unsigned m_adaptive_budget;
+    double m_adaptive_tolerance;
+    size_t m_decimation_threshold;
+    double m_decimation_tolerance;
+    int m_coordinate_decimals;
+    double m_path_quantum;
+    bool m_gzip;
+    bool m_streaming;
+    bool m_frame_written;
 };
 
 } // namespace
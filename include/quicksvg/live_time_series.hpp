@@ -0,0 +1,329 @@
+#ifndef QUICKSVG_LIVE_TIME_SERIES_HPP
+#define QUICKSVG_LIVE_TIME_SERIES_HPP
+
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <quicksvg/detail/format.hpp>
+#include <quicksvg/detail/generic_svg_functionality.hpp>
+#include <quicksvg/detail/path.hpp>
+#include <quicksvg/detail/svg_document.hpp>
+
+namespace quicksvg {
+
+// The latest `capacity` samples of an unbounded series, for monitoring: append() is amortized O(1) and keeps the
+// window's min and max in monotonic deques, and snapshot() writes the window as a time series plot.
+// The prelude and the screen x of each window position never change and are formatted once; a sample's screen y
+// is formatted once and reused by later snapshots until the window's y range changes, and the axes and gridlines
+// are reused until the window's start time or y range changes.
+template<class Real>
+class live_time_series
+{
+public:
+    live_time_series(size_t capacity, Real start_time, Real time_step, std::string const & title, int width = 1100) :
+        m_capacity{capacity},
+        m_start_time{start_time},
+        m_time_step{time_step},
+        m_count{0},
+        m_samples(capacity),
+        m_y(capacity),
+        m_formatted_count{0},
+        m_formatted_min{0},
+        m_formatted_max{0},
+        m_frame_t0{0},
+        m_frame_min{0},
+        m_frame_max{0},
+        m_coordinate_decimals{detail::default_coordinate_decimals},
+        m_path_quantum{0},
+        m_gzip{false},
+        m_connect{true},
+        m_connect_color{"steelblue"},
+        m_dot_color{"orange"}
+    {
+        if (capacity < 2)
+        {
+            throw std::domain_error("A live time series needs a capacity of at least 2 samples.");
+        }
+        if (time_step <= 0)
+        {
+            throw std::domain_error("time_step > 0 is required.");
+        }
+        m_margin_top = 40;
+        m_margin_left = 25;
+        int height = static_cast<int>(std::floor(Real(width)/1.61803));
+        m_graph_height = height - 20 - m_margin_top;
+        m_graph_width = width - m_margin_left - 20;
+
+        std::ostringstream prelude;
+        detail::write_prelude(prelude, title, width, height, m_margin_top);
+        m_prelude = prelude.str();
+
+        m_x.resize(capacity);
+        format_x();
+    }
+
+    void set_coordinate_decimals(int decimals)
+    {
+        m_coordinate_decimals = detail::checked_coordinate_decimals(decimals);
+        format_x();
+        // Everything formatted so far has the old number of decimals:
+        m_formatted_min = std::numeric_limits<Real>::quiet_NaN();
+        m_frame.clear();
+    }
+
+    // Write the path as relative l/h/v steps on a grid of quantum_px pixels, with duplicate points dropped.
+    void set_compact_paths(bool compact, double quantum_px = 0.1)
+    {
+        if (compact && !(quantum_px > 0))
+        {
+            throw std::domain_error("The path quantum must be positive; requested " + std::to_string(quantum_px));
+        }
+        m_path_quantum = compact ? quantum_px : 0;
+    }
+
+    // Write gzip-compressed SVG, as is always done for .svgz and .svg.gz filenames. Requires QUICKSVG_HAS_ZLIB.
+    void set_gzip(bool gzip)
+    {
+        m_gzip = detail::checked_gzip(gzip);
+    }
+
+    void set_style(bool connect_the_dots, std::string const & connect_color = "steelblue", std::string const & dot_color = "orange")
+    {
+        m_connect = connect_the_dots;
+        m_connect_color = connect_color;
+        m_dot_color = dot_color;
+    }
+
+    void append(Real y)
+    {
+        using std::isnan;
+        if (isnan(y))
+        {
+            throw std::domain_error("Cannot plot a NaN.");
+        }
+        size_t n = m_count++;
+        m_samples[n % m_capacity] = y;
+        while (!m_max.empty() && !(m_max.back().second > y))
+        {
+            m_max.pop_back();
+        }
+        m_max.emplace_back(n, y);
+        while (!m_min.empty() && !(m_min.back().second < y))
+        {
+            m_min.pop_back();
+        }
+        m_min.emplace_back(n, y);
+        // Drop whatever has slid out of the window:
+        if (m_max.front().first + m_capacity <= n)
+        {
+            m_max.pop_front();
+        }
+        if (m_min.front().first + m_capacity <= n)
+        {
+            m_min.pop_front();
+        }
+    }
+
+    // The number of samples in the window.
+    size_t size() const
+    {
+        return m_count < m_capacity ? m_count : m_capacity;
+    }
+
+    Real min() const
+    {
+        return m_min.empty() ? std::numeric_limits<Real>::quiet_NaN() : m_min.front().second;
+    }
+
+    Real max() const
+    {
+        return m_max.empty() ? std::numeric_limits<Real>::quiet_NaN() : m_max.front().second;
+    }
+
+    // Writes the window, oldest sample at the left edge; until the window fills, the right of the graph is empty.
+    void snapshot(std::string const & filename)
+    {
+        size_t m = size();
+        if (m == 0)
+        {
+            throw std::logic_error("There are no samples to plot.\n");
+        }
+        size_t first = m_count - m;
+        Real min_y = min();
+        Real max_y = max();
+        // A flat window would have zero height:
+        if (!(min_y < max_y))
+        {
+            min_y -= 1;
+            max_y += 1;
+        }
+        format_y(first, min_y, max_y);
+
+        Real t0 = m_start_time + first*m_time_step;
+        if (m_frame.empty() || t0 != m_frame_t0 || min_y != m_frame_min || max_y != m_frame_max)
+        {
+            std::ostringstream frame;
+            frame << detail::coordinate_decimals{m_coordinate_decimals};
+            write_frame(frame, t0, t0 + (m_capacity - 1)*m_time_step, min_y, max_y);
+            m_frame = frame.str();
+            m_frame_t0 = t0;
+            m_frame_min = min_y;
+            m_frame_max = max_y;
+        }
+
+        detail::svg_document fs;
+        if (m_gzip || detail::is_gzip_filename(filename))
+        {
+            fs.start_gzip();
+        }
+        fs.reserve(m_prelude.size() + m_frame.size() + m*(m_connect ? 64 : 48));
+        fs << detail::coordinate_decimals{m_coordinate_decimals};
+        fs << m_prelude << m_frame;
+        if (m_connect && m_path_quantum > 0)
+        {
+            std::vector<double> x(m);
+            std::vector<double> y(m);
+            for (size_t j = 0; j < m; ++j)
+            {
+                x[j] = static_cast<double>((Real(j)/Real(m_capacity - 1))*static_cast<Real>(m_graph_width));
+                y[j] = static_cast<double>(((max_y - m_samples[(first + j) % m_capacity])/(max_y - min_y))*static_cast<Real>(m_graph_height));
+            }
+            fs << "<path d='";
+            detail::write_path_points(fs, x, y, m, 0, m_path_quantum);
+            fs << "' stroke='" << m_connect_color << "' stroke-width='1' fill='none'></path>\n";
+        }
+        else if (m_connect)
+        {
+            fs << "<path d='M";
+            write_point(fs, first);
+            for (size_t i = first + 1; i < m_count; ++i)
+            {
+                fs << " L";
+                write_point(fs, i);
+            }
+            fs << "' stroke='" << m_connect_color << "' stroke-width='1' fill='none'></path>\n";
+        }
+        for (size_t i = first; i < m_count; ++i)
+        {
+            fs << "<circle cx='";
+            fs.write(m_x[i - first].text, m_x[i - first].size);
+            fs << "' cy='";
+            slot const & y = m_y[i % m_capacity];
+            fs.write(y.text, y.size);
+            fs << "' r='1' fill='" << m_dot_color << "' />\n";
+        }
+        fs << "</g>\n"
+           << "</svg>\n";
+        fs.commit(filename);
+    }
+
+private:
+    struct slot
+    {
+        char text[32];
+        unsigned char size;
+    };
+
+    void format_x()
+    {
+        for (size_t j = 0; j < m_capacity; ++j)
+        {
+            char* end = detail::format_coordinate(m_x[j].text, static_cast<double>((Real(j)/Real(m_capacity - 1))*static_cast<Real>(m_graph_width)),
+                                                  m_coordinate_decimals);
+            m_x[j].size = static_cast<unsigned char>(end - m_x[j].text);
+        }
+    }
+
+    // Sample numbers [m_formatted_count, m_count) have not been formatted for the current range; if the range has
+    // changed since the last snapshot, none have.
+    void format_y(size_t first, Real min_y, Real max_y)
+    {
+        if (min_y != m_formatted_min || max_y != m_formatted_max || m_formatted_count < first)
+        {
+            m_formatted_count = first;
+            m_formatted_min = min_y;
+            m_formatted_max = max_y;
+        }
+        for (size_t i = m_formatted_count; i < m_count; ++i)
+        {
+            slot & s = m_y[i % m_capacity];
+            Real y = ((max_y - m_samples[i % m_capacity])/(max_y - min_y))*static_cast<Real>(m_graph_height);
+            s.size = static_cast<unsigned char>(detail::format_coordinate(s.text, static_cast<double>(y), m_coordinate_decimals) - s.text);
+        }
+        m_formatted_count = m_count;
+    }
+
+    void write_point(std::ostream & fs, size_t i)
+    {
+        size_t j = i - (m_count - size());
+        fs.write(m_x[j].text, m_x[j].size);
+        fs.put(' ');
+        slot const & y = m_y[i % m_capacity];
+        fs.write(y.text, y.size);
+    }
+
+    // The axes and gridlines, which move with the window:
+    void write_frame(std::ostream & fs, Real min_x, Real max_x, Real min_y, Real max_y)
+    {
+        auto x_scale = [&](Real x)->Real
+        {
+            return ((x - min_x)/(max_x - min_x))*static_cast<Real>(m_graph_width);
+        };
+        auto y_scale = [&](Real y)->Real
+        {
+            return ((max_y - y)/(max_y - min_y))*static_cast<Real>(m_graph_height);
+        };
+        fs << "<g transform='translate(" << m_margin_left << ", " << m_margin_top << ")'>\n";
+        fs << "<line x1='0' y1='0' x2='0' y2='" << m_graph_height
+           << "' stroke='gray' stroke-width='1' />\n";
+        Real x_axis_loc = m_graph_height;
+        if (min_y <= 0 && max_y >= 0)
+        {
+            x_axis_loc = y_scale(0);
+        }
+        fs << "<line x1='0' y1='" << detail::coordinate(x_axis_loc)
+           << "' x2='" << m_graph_width << "' y2='" << detail::coordinate(x_axis_loc)
+           << "' stroke='gray' stroke-width='1' />\n";
+        detail::write_gridlines(fs, 8, 10, x_scale, y_scale, min_x, max_x, min_y, max_y,
+                                m_graph_width, m_graph_height, m_margin_left);
+    }
+
+    size_t m_capacity;
+    Real m_start_time;
+    Real m_time_step;
+    // Samples appended so far; sample i is kept in slot i % m_capacity until it leaves the window.
+    size_t m_count;
+    std::vector<Real> m_samples;
+    // (sample number, value), with values strictly decreasing in m_max and strictly increasing in m_min:
+    std::deque<std::pair<size_t, Real>> m_max;
+    std::deque<std::pair<size_t, Real>> m_min;
+    std::string m_prelude;
+    std::vector<slot> m_x;
+    std::vector<slot> m_y;
+    size_t m_formatted_count;
+    Real m_formatted_min;
+    Real m_formatted_max;
+    // The axes and gridlines of the window starting at m_frame_t0 with y range [m_frame_min, m_frame_max]:
+    std::string m_frame;
+    Real m_frame_t0;
+    Real m_frame_min;
+    Real m_frame_max;
+    int m_coordinate_decimals;
+    double m_path_quantum;
+    bool m_gzip;
+    bool m_connect;
+    std::string m_connect_color;
+    std::string m_dot_color;
+    int m_margin_top;
+    int m_margin_left;
+    int m_graph_width;
+    int m_graph_height;
+};
+
+} // namespace quicksvg
+#endif
@@ -2,12 +2,22 @@
 #define QUICKSVG_PLOT_TIME_SERIES_HPP
 
 #include <cassert>
+#include <memory>
 #include <vector>
 #include <string>
 #include <utility>
-#include <fstream>
 #include <algorithm>
+#include <iostream>
+#include <variant>
+#include <quicksvg/detail/dataset.hpp>
 #include <quicksvg/detail/generic_svg_functionality.hpp>
+#include <quicksvg/detail/mapped_file.hpp>
+#include <quicksvg/detail/occupancy.hpp>
+#include <quicksvg/detail/svg_document.hpp>
+#include <quicksvg/detail/path.hpp>
+#include <quicksvg/detail/pyramid.hpp>
+#include <quicksvg/binary_series.hpp>
+#include <quicksvg/fixed_axes.hpp>
 
 namespace quicksvg {
 
@@ -17,18 +27,29 @@ class plot_time_series
 public:
     plot_time_series(Real start_time, Real time_step, std::string const & title,
                      std::string const & filename, int width = 1100) :
+                    m_filename{filename},
                     m_start_time{start_time},
                     m_end_time{std::numeric_limits<Real>::lowest()},
                     m_time_step{time_step},
                     m_min_y{std::numeric_limits<Real>::max()},
                     m_max_y{std::numeric_limits<Real>::lowest()},
-                    m_is_written{false}
-
+                    m_is_written{false},
+                    m_decimation_threshold{detail::default_decimation_threshold},
+                    m_decimation_tolerance{0},
+                    m_coordinate_decimals{detail::default_coordinate_decimals},
+                    m_path_quantum{0},
+                    m_gzip{detail::checked_gzip(detail::is_gzip_filename(filename))},
+                    m_threads{1},
+                    m_streaming{false},
+                    m_frame_written{false},
+                    m_series_open{false},
+                    m_series_length{0},
+                    m_title{title},
+                    m_width{width}
     {
         if (time_step <= 0) {
             throw std::domain_error("time_step > 0 is required.");
         }
-        m_fs.open(filename);
 
         m_margin_top = 40;
         m_margin_left = 25;
@@ -42,34 +63,162 @@ public:
         detail::write_prelude(m_fs, title, width, height, m_margin_top);
     }
 
+    // Streaming: with the axes fixed up front, each series is written as its samples arrive and nothing is retained.
+    // The first sample is at axes.x_min; samples past axes.x_max are dropped, and values outside [y_min, y_max] run off the graph.
+    plot_time_series(fixed_axes<Real> const & axes, Real time_step, std::string const & title,
+                     std::string const & filename, int width = 1100) :
+                    plot_time_series(axes.x_min, time_step, title, filename, width)
+    {
+        axes.check();
+        m_end_time = axes.x_max;
+        m_min_y = axes.y_min;
+        m_max_y = axes.y_max;
+        m_streaming = true;
+    }
+
+    // Connecting paths with more than max_points points are reduced to the first, last, lowest and highest point of each
+    // pixel column, and then, if tolerance_px > 0, simplified with Douglas-Peucker to within tolerance_px pixels.
+    void set_decimation(size_t max_points, double tolerance_px = 0)
+    {
+        m_decimation_threshold = max_points;
+        m_decimation_tolerance = tolerance_px;
+    }
+
+    // Decimals written for screen coordinates; the default, 2, is 0.01px.
+    void set_coordinate_decimals(int decimals)
+    {
+        m_coordinate_decimals = detail::checked_coordinate_decimals(decimals);
+    }
+
+    // Write paths as relative l/h/v steps on a grid of quantum_px pixels, with duplicate points dropped.
+    // Typically 2-4x smaller than the default absolute coordinates.
+    void set_compact_paths(bool compact, double quantum_px = 0.1)
+    {
+        if (compact && !(quantum_px > 0))
+        {
+            throw std::domain_error("The path quantum must be positive; requested " + std::to_string(quantum_px));
+        }
+        m_path_quantum = compact ? quantum_px : 0;
+    }
+
+    // Write gzip-compressed SVG. On by default for .svgz and .svg.gz filenames. Requires QUICKSVG_HAS_ZLIB.
+    void set_gzip(bool gzip)
+    {
+        m_gzip = detail::checked_gzip(gzip);
+    }
+
+    // Scan datasets for their range on this many threads (0 = every core).
+    void set_threads(unsigned threads)
+    {
+        m_threads = threads;
+    }
+
     void add_dataset(std::vector<Real> const & v, bool connect_the_dots = true,
                      std::string connect_color = "steelblue", std::string dot_color="orange")
     {
-        if (m_is_written)
+        add_view(detail::dataset_view<Real>(std::vector<Real>(v)), connect_the_dots, connect_color, dot_color);
+    }
+
+    // Moves v into the plot rather than copying it.
+    void add_dataset(std::vector<Real> && v, bool connect_the_dots = true,
+                     std::string connect_color = "steelblue", std::string dot_color="orange")
+    {
+        add_view(detail::dataset_view<Real>(std::move(v)), connect_the_dots, connect_color, dot_color);
+    }
+
+    // Shares v with the caller; nothing is copied.
+    void add_dataset(std::shared_ptr<std::vector<Real> const> v, bool connect_the_dots = true,
+                     std::string connect_color = "steelblue", std::string dot_color="orange")
+    {
+        add_view(detail::dataset_view<Real>(std::move(v)), connect_the_dots, connect_color, dot_color);
+    }
+
+    // Views the size samples at data without copying them. They must stay alive and unchanged until write_all().
+    void add_dataset(Real const * data, size_t size, bool connect_the_dots = true,
+                     std::string connect_color = "steelblue", std::string dot_color="orange")
+    {
+        add_view(detail::dataset_view<Real>(data, size), connect_the_dots, connect_color, dot_color);
+    }
+
+    // Plots one series of a raw binary file, which is memory-mapped rather than read: nothing is copied into memory,
+    // and write_all() decimates straight from the mapping. Call once per series for files holding several.
+    void add_binary_file(std::string const & filename, binary_series const & layout, bool connect_the_dots = true,
+                         std::string connect_color = "steelblue", std::string dot_color="orange")
+    {
+        auto file = std::make_shared<detail::mapped_file const>(filename);
+        if (file->data() == nullptr)
         {
-            throw std::logic_error("Cannot add data to graph after writing it.\n");
+            throw std::runtime_error("Unable to read " + filename);
         }
-
-        auto result = std::minmax_element(v.begin(), v.end());
-        if (*result.first < m_min_y)
+        if (file->size() < layout.extent())
+        {
+            throw std::domain_error("The layout needs " + std::to_string(layout.extent()) + " bytes, but "
+                                    + filename + " has only " + std::to_string(file->size()));
+        }
+        unsigned char const * first = file->data() + layout.offset;
+        if (layout.dtype == sample_type::float32)
         {
-            m_min_y = *result.first;
+            add_view(detail::strided_view<float>(file, first, layout.packed_stride(), layout.count),
+                     connect_the_dots, connect_color, dot_color);
         }
-        if (*result.second > m_max_y)
+        else
         {
-            m_max_y = *result.second;
+            add_view(detail::strided_view<double>(file, first, layout.packed_stride(), layout.count),
+                     connect_the_dots, connect_color, dot_color);
         }
+    }
 
-        Real end_time = m_start_time + m_time_step*(v.size() - 1);
-        if (end_time > m_end_time)
+    // Streaming only: starts a series whose samples then arrive through append(), in chunks of any size.
+    // Past the decimation threshold only the first, last, lowest and highest sample of each pixel column are kept,
+    // and a dot is drawn on each pixel some sample lands on, so memory is bounded by the picture however long the series runs.
+    void begin_series(bool connect_the_dots = true, std::string connect_color = "steelblue", std::string dot_color="orange")
+    {
+        if (!m_streaming)
         {
-            m_end_time = end_time;
+            throw std::logic_error("begin_series requires a plot constructed with fixed axes.\n");
         }
-        m_connect.push_back(connect_the_dots);
-        m_connect_color.push_back(connect_color);
-        m_dot_color.push_back(dot_color);
-        m_dataset.push_back(v);
+        if (m_is_written)
+        {
+            throw std::logic_error("Cannot add data to graph after writing it.\n");
+        }
+        end_series();
+        write_frame();
+        m_series = detail::m4_stream(m_decimation_threshold);
+        m_series_dots = canvas_dots();
+        m_series_open = true;
+        m_series_length = 0;
+        m_series_connect = connect_the_dots;
+        m_series_connect_color = connect_color;
+        m_series_dot_color = dot_color;
+    }
 
+    void append(Real const * y, size_t n)
+    {
+        append_samples(detail::dataset_view<Real>(y, n));
+    }
+
+    void append(Real y)
+    {
+        append(&y, 1);
+    }
+
+    // Writes the open series, if any. begin_series and write_all call this too.
+    void end_series()
+    {
+        if (!m_series_open)
+        {
+            return;
+        }
+        m_series_open = false;
+        std::vector<double> t;
+        std::vector<double> y;
+        bool decimated = m_series.finish(t, y);
+        write_points(t, y, decimated, m_series_connect, m_series_connect_color, m_series_dot_color);
+        if (decimated)
+        {
+            write_dots(m_series_dots.x(), m_series_dots.y(), m_series_dot_color);
+        }
+        m_series_dots = detail::pixel_dots();
     }
 
     void write_all()
@@ -78,17 +227,159 @@ public:
         {
             throw std::logic_error("Data is already written to the svg.\n");
         }
-        // Maps [a,b] to [0, graph_width]
-        auto x_scale = [this](Real x)->Real
+        if (m_streaming)
         {
-            return ((x-m_start_time)/(m_end_time- m_start_time))*static_cast<Real>(m_graph_width);
-        };
+            end_series();
+            write_frame();
+            m_fs << "</g>\n"
+                 << "</svg>\n";
+            m_fs.commit(m_filename);
+            m_is_written = true;
+            return;
+        }
 
-        auto y_scale = [this](Real y)-> Real
+        size_t bytes = 4096;
+        for (auto const & v : m_dataset)
         {
-          return ((m_max_y - y)/(m_max_y - m_min_y) )*static_cast<Real>(m_graph_height);
-        };
+            size_t n = std::visit([](auto const & view) { return view.size(); }, v);
+            bytes += 128 + 64*std::min(n, m_decimation_threshold);
+        }
+        if (m_gzip)
+        {
+            m_fs.start_gzip();
+        }
+        m_fs.reserve(bytes);
+        write_frame();
+
+        for (size_t i = 0; i < m_connect.size(); ++i)
+        {
+            std::visit([&](auto const & v) { write_dataset(v, m_connect[i], m_connect_color[i], m_dot_color[i]); }, m_dataset[i]);
+        }
+
+        m_fs << "</g>\n"
+           << "</svg>\n";
+        m_fs.commit(m_filename);
+
+        m_is_written = true;
+
+    }
+
+    // Writes the samples with times in [t0, t1] to their own file, scaled to that window. Each dataset gets a min/max
+    // pyramid on first use, which then finds the extremes of each pixel column in O(log n) lookups plus a scan of at
+    // most two partial blocks of 1024 samples, so a window costs O(pixels (log n + 2048)) rather than a scan of every
+    // sample. Can be called any number of times, before or after write_all().
+    void write_range(Real t0, Real t1, std::string const & filename)
+    {
+        if (m_streaming)
+        {
+            throw std::logic_error("write_range needs the datasets, which a plot with fixed axes does not keep.\n");
+        }
+        if (!(t0 < t1))
+        {
+            throw std::domain_error("write_range needs t0 < t1.");
+        }
+        Real min_y = std::numeric_limits<Real>::max();
+        Real max_y = std::numeric_limits<Real>::lowest();
+        std::vector<std::pair<size_t, size_t>> ranges(m_dataset.size());
+        for (size_t i = 0; i < m_dataset.size(); ++i)
+        {
+            std::visit([&](auto const & v)
+            {
+                size_t begin = samples_before(t0, v.size(), false);
+                size_t end = samples_before(t1, v.size(), true);
+                ranges[i] = {begin, end};
+                if (begin < end)
+                {
+                    auto extremes = pyramid(i).query(v, begin, end);
+                    if (v[extremes.first] < min_y)
+                    {
+                        min_y = v[extremes.first];
+                    }
+                    if (v[extremes.second] > max_y)
+                    {
+                        max_y = v[extremes.second];
+                    }
+                }
+            }, m_dataset[i]);
+        }
+        if (max_y < min_y)
+        {
+            throw std::domain_error("No samples lie in [t0, t1].");
+        }
+
+        plot_time_series window(t0, m_time_step, m_title, filename, m_width);
+        window.m_end_time = t1;
+        window.m_min_y = min_y;
+        window.m_max_y = max_y;
+        window.m_decimation_threshold = m_decimation_threshold;
+        window.m_decimation_tolerance = m_decimation_tolerance;
+        window.m_coordinate_decimals = m_coordinate_decimals;
+        window.m_path_quantum = m_path_quantum;
+        window.write_frame();
+        for (size_t i = 0; i < m_dataset.size(); ++i)
+        {
+            if (ranges[i].first < ranges[i].second)
+            {
+                std::visit([&](auto const & v)
+                {
+                    window.write_window(v, pyramid(i), ranges[i].first, ranges[i].second, m_start_time,
+                                        m_connect[i], m_connect_color[i], m_dot_color[i]);
+                }, m_dataset[i]);
+            }
+        }
+        window.m_fs << "</g>\n"
+                    << "</svg>\n";
+        window.m_fs.commit(filename);
+        window.m_is_written = true;
+    }
+
+    // Saves the min/max pyramid of dataset i, building it if need be, for a later plot of the same data to load.
+    void save_range_index(size_t i, std::string const & filename)
+    {
+        pyramid(i).save(filename);
+    }
+
+    // Loads a pyramid saved by save_range_index, rather than scanning dataset i to build one.
+    void load_range_index(size_t i, std::string const & filename)
+    {
+        check_dataset_index(i);
+        size_t n = std::visit([](auto const & v) { return v.size(); }, m_dataset[i]);
+        m_pyramids[i] = std::make_shared<detail::minmax_pyramid const>(detail::minmax_pyramid::load(filename, n));
+    }
+
+    ~plot_time_series()
+    {
+        if (!m_is_written)
+        {
+            std::cerr << "Warning: You did not write your data to disk!\n";
+        }
+    }
+
+private:
+    // Maps [a,b] to [0, graph_width]
+    Real x_scale(Real x) const
+    {
+        return ((x-m_start_time)/(m_end_time- m_start_time))*static_cast<Real>(m_graph_width);
+    }
+
+    Real y_scale(Real y) const
+    {
+        return ((m_max_y - y)/(m_max_y - m_min_y) )*static_cast<Real>(m_graph_height);
+    }
 
+    // The axes and gridlines, written once, as soon as the ranges are known.
+    void write_frame()
+    {
+        if (m_frame_written)
+        {
+            return;
+        }
+        m_frame_written = true;
+        if (m_gzip)
+        {
+            m_fs.start_gzip();
+        }
+        m_fs << detail::coordinate_decimals{m_coordinate_decimals};
           // Construct SVG group to simplify the calculations slightly:
         m_fs << "<g transform='translate(" << m_margin_left << ", " << m_margin_top << ")'>\n";
              // y-axis:
@@ -101,57 +392,247 @@ public:
         {
             x_axis_loc = y_scale(0);
         }
-        m_fs << "<line x1='0' y1='" << x_axis_loc
-             << "' x2='" << m_graph_width << "' y2='" << x_axis_loc
+        m_fs << "<line x1='0' y1='" << detail::coordinate(x_axis_loc)
+             << "' x2='" << m_graph_width << "' y2='" << detail::coordinate(x_axis_loc)
              << "' stroke='gray' stroke-width='1' />\n";
 
-        detail::write_gridlines(m_fs, 8, 10, x_scale, y_scale, m_start_time, m_end_time,
-                                m_min_y, m_max_y, m_graph_width, m_graph_height, m_margin_left);
+        detail::write_gridlines(m_fs, 8, 10, [this](Real x) { return x_scale(x); }, [this](Real y) { return y_scale(y); },
+                                m_start_time, m_end_time, m_min_y, m_max_y, m_graph_width, m_graph_height, m_margin_left);
+    }
 
+    void check_dataset_index(size_t i) const
+    {
+        if (i >= m_dataset.size())
+        {
+            throw std::domain_error("There is no dataset " + std::to_string(i) + "; only " + std::to_string(m_dataset.size())
+                                    + " have been added.");
+        }
+    }
 
-        for (size_t i = 0; i < m_connect.size(); ++i)
+    detail::minmax_pyramid const & pyramid(size_t i)
+    {
+        check_dataset_index(i);
+        if (!m_pyramids[i])
         {
-            bool connect_the_dots = m_connect[i];
-            auto const & v = m_dataset[i];
-            std::string const & stroke = m_connect_color[i];
-            std::string const & dot_color = m_dot_color[i];
-            if(connect_the_dots)
+            m_pyramids[i] = std::visit([this](auto const & v)
             {
-                m_fs << "<path d='M" << x_scale(m_start_time) << " " << y_scale(v[0]);
-                for (size_t j = 1; j < v.size(); ++j)
+                return std::make_shared<detail::minmax_pyramid const>(v, m_threads);
+            }, m_dataset[i]);
+        }
+        return *m_pyramids[i];
+    }
+
+    // How many of the first n samples come before time t, or at or before it if inclusive.
+    size_t samples_before(Real t, size_t n, bool inclusive) const
+    {
+        auto before = [&](size_t i)
+        {
+            Real s = m_start_time + i*m_time_step;
+            return inclusive ? s <= t : s < t;
+        };
+        double estimate = static_cast<double>((t - m_start_time)/m_time_step);
+        size_t k = !(estimate > 0) ? 0 : estimate >= static_cast<double>(n) ? n : static_cast<size_t>(estimate);
+        while (k < n && before(k))
+        {
+            ++k;
+        }
+        while (k > 0 && !before(k - 1))
+        {
+            --k;
+        }
+        return k;
+    }
+
+    // Samples [begin, end) of a dataset whose first sample is at time origin: all of them or, past the decimation
+    // threshold, the M4 points of each pixel column, with the column found by bisection and its extremes by the pyramid.
+    template<class View>
+    void write_window(View const & v, detail::minmax_pyramid const & pyramid, size_t begin, size_t end, Real origin,
+                      bool connect_the_dots, std::string const & stroke, std::string const & dot_color)
+    {
+        using std::floor;
+        auto x = [&](size_t i) { return static_cast<double>(x_scale(origin + i*m_time_step)); };
+        std::vector<double> t;
+        std::vector<double> y;
+        auto keep = [&](size_t i)
+        {
+            t.push_back(x(i));
+            y.push_back(static_cast<double>(y_scale(v[i])));
+        };
+        bool decimated = end - begin > m_decimation_threshold;
+        if (!decimated)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                keep(i);
+            }
+        }
+        size_t first = begin;
+        while (decimated && first < end)
+        {
+            double column = floor(x(first));
+            size_t lo = first + 1;
+            size_t hi = end;
+            while (lo < hi)
+            {
+                size_t mid = lo + (hi - lo)/2;
+                if (floor(x(mid)) == column)
+                {
+                    lo = mid + 1;
+                }
+                else
                 {
-                    Real t = x_scale(m_start_time + j*m_time_step);
-                    m_fs << " L" << t << " " << y_scale(v[j]);
+                    hi = mid;
                 }
-                m_fs << "' stroke='" << stroke << "' stroke-width='1' fill='none'></path>\n";
             }
+            auto extremes = pyramid.query(v, first, lo);
+            // The four points in index order, without repeats:
+            size_t candidates[4] = {first, std::min(extremes.first, extremes.second), std::max(extremes.first, extremes.second), lo - 1};
+            size_t kept = first;
+            keep(first);
+            for (size_t c : candidates)
+            {
+                if (c > kept)
+                {
+                    keep(c);
+                    kept = c;
+                }
+            }
+            first = lo;
+        }
+        write_points(t, y, decimated, connect_the_dots, stroke, dot_color);
+        // A window never visits every sample, so its dots are at the kept points:
+        if (decimated)
+        {
+            write_dots(t, y, dot_color);
+        }
+    }
 
-            for (size_t j = 0; j < v.size(); ++j)
+    template<class View>
+    void append_samples(View const & v)
+    {
+        if (!m_series_open)
+        {
+            throw std::logic_error("Call begin_series before appending samples.\n");
+        }
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            Real t = m_start_time + m_series_length++*m_time_step;
+            if (t > m_end_time)
             {
-                Real t = x_scale(m_start_time + j*m_time_step);
-                m_fs << "<circle cx='" << t << "' cy='" << y_scale(v[j])
-                     << "' r='1' fill='" << dot_color << "' />\n";
+                continue;
             }
+            double x = static_cast<double>(x_scale(t));
+            double y = static_cast<double>(y_scale(v[i]));
+            m_series.push(x, y);
+            m_series_dots.push(x, y);
         }
+    }
 
-        m_fs << "</g>\n"
-           << "</svg>\n";
-        m_fs.close();
+    // Past the decimation threshold, a series is reduced to the M4 points of each pixel column as it is scaled,
+    // so neither the samples nor their screen coordinates are ever held in full. Dots are then drawn one per pixel
+    // that any sample lands on, at the first sample to land there, which looks much the same as one per sample.
+    template<class View>
+    void write_dataset(View const & v, bool connect_the_dots, std::string const & stroke, std::string const & dot_color)
+    {
+        detail::m4_stream points(m_decimation_threshold);
+        detail::pixel_dots dots = canvas_dots();
+        for (size_t j = 0; j < v.size(); ++j)
+        {
+            double x = static_cast<double>(x_scale(m_start_time + j*m_time_step));
+            double y = static_cast<double>(y_scale(v[j]));
+            points.push(x, y);
+            dots.push(x, y);
+        }
+        std::vector<double> t;
+        std::vector<double> y;
+        bool decimated = points.finish(t, y);
+        write_points(t, y, decimated, connect_the_dots, stroke, dot_color);
+        if (decimated)
+        {
+            write_dots(dots.x(), dots.y(), dot_color);
+        }
+    }
 
-        m_is_written = true;
+    // The path through t, y and, unless decimated, a dot at each point; a decimated series writes its dots separately.
+    void write_points(std::vector<double> const & t, std::vector<double> const & y, bool decimated,
+                      bool connect_the_dots, std::string const & stroke, std::string const & dot_color)
+    {
+        if (t.empty())
+        {
+            return;
+        }
+        if (connect_the_dots)
+        {
+            m_fs << "<path d='";
+            detail::write_path_points(m_fs, t, y, decimated ? 0 : m_decimation_threshold, m_decimation_tolerance, m_path_quantum);
+            m_fs << "' stroke='" << stroke << "' stroke-width='1' fill='none'></path>\n";
+        }
+        if (!decimated)
+        {
+            write_dots(t, y, dot_color);
+        }
+    }
 
+    void write_dots(std::vector<double> const & t, std::vector<double> const & y, std::string const & dot_color)
+    {
+        for (size_t j = 0; j < t.size(); ++j)
+        {
+            m_fs << "<circle cx='" << detail::coordinate(t[j]) << "' cy='" << detail::coordinate(y[j])
+                 << "' r='1' fill='" << dot_color << "' />\n";
+        }
     }
 
-    ~plot_time_series()
+    // Collects one dot per pixel of the whole picture, margins included.
+    detail::pixel_dots canvas_dots() const
     {
-        if (!m_is_written)
+        return detail::pixel_dots(-m_margin_left, -m_margin_top, m_margin_left + m_graph_width + m_margin_right,
+                                  m_margin_top + m_graph_height + m_margin_bottom);
+    }
+
+    template<class View>
+    void add_view(View v, bool connect_the_dots, std::string connect_color, std::string dot_color)
+    {
+        if (m_is_written)
         {
-            std::cerr << "Warning: You did not write your data to disk!\n";
+            throw std::logic_error("Cannot add data to graph after writing it.\n");
+        }
+        if (m_streaming)
+        {
+            begin_series(connect_the_dots, connect_color, dot_color);
+            append_samples(v);
+            end_series();
+            return;
+        }
+        if (v.empty())
+        {
+            throw std::domain_error("Cannot plot an empty dataset.");
+        }
+
+        auto result = detail::parallel_minmax(v, m_threads);
+        if (result.first < m_min_y)
+        {
+            m_min_y = result.first;
         }
+        if (result.second > m_max_y)
+        {
+            m_max_y = result.second;
+        }
+
+        Real end_time = m_start_time + m_time_step*(v.size() - 1);
+        if (end_time > m_end_time)
+        {
+            m_end_time = end_time;
+        }
+        m_connect.push_back(connect_the_dots);
+        m_connect_color.push_back(connect_color);
+        m_dot_color.push_back(dot_color);
+        m_pyramids.emplace_back();
+        m_dataset.emplace_back(std::in_place_type<View>, std::move(v));
+
     }
 
-private:
-    std::ofstream m_fs;
+    std::string m_filename;
+    detail::svg_document m_fs;
     Real m_start_time;
     Real m_end_time;
     Real m_time_step;
@@ -160,7 +641,7 @@ private:
     bool m_is_written;
     std::vector<bool> m_connect;
     // Should be a list:
-    std::vector<std::vector<Real>> m_dataset;
+    std::vector<std::variant<detail::dataset_view<Real>, detail::strided_view<float>, detail::strided_view<double>>> m_dataset;
     std::vector<std::string> m_connect_color;
     std::vector<std::string> m_dot_color;
     int m_margin_top;
@@ -169,6 +650,26 @@ private:
     int m_margin_right;
     int m_graph_width;
     int m_graph_height;
+    size_t m_decimation_threshold;
+    double m_decimation_tolerance;
+    int m_coordinate_decimals;
+    double m_path_quantum;
+    bool m_gzip;
+    unsigned m_threads;
+    bool m_streaming;
+    bool m_frame_written;
+    // The series being streamed:
+    bool m_series_open;
+    size_t m_series_length;
+    detail::m4_stream m_series;
+    detail::pixel_dots m_series_dots;
+    bool m_series_connect;
+    std::string m_series_connect_color;
+    std::string m_series_dot_color;
+    std::string m_title;
+    int m_width;
+    // Built on the first write_range, or loaded; null until then.
+    std::vector<std::shared_ptr<detail::minmax_pyramid const>> m_pyramids;
 };
 
 } // namespace
@@ -2,13 +2,18 @@
 #define QUICKSVG_SCATTER_PLOT_HPP
 
 #include <cassert>
+#include <memory>
 #include <vector>
 #include <string>
 #include <utility>
-#include <fstream>
 #include <algorithm>
 #include <iostream>
+#include <quicksvg/detail/dataset.hpp>
 #include <quicksvg/detail/generic_svg_functionality.hpp>
+#include <quicksvg/detail/occupancy.hpp>
+#include <quicksvg/detail/path.hpp>
+#include <quicksvg/detail/svg_document.hpp>
+#include <quicksvg/fixed_axes.hpp>
 
 namespace quicksvg {
 
@@ -21,14 +26,19 @@ public:
                  std::string const & x_label = "",
                  std::string const & y_label = "",
                  int width = 1100) :
+                    m_filename{filename},
                     m_min_x{std::numeric_limits<Real>::max()},
                     m_max_x{std::numeric_limits<Real>::lowest()},
                     m_min_y{std::numeric_limits<Real>::max()},
                     m_max_y{std::numeric_limits<Real>::lowest()},
-                    m_is_written{false}
+                    m_is_written{false},
+                    m_coordinate_decimals{detail::default_coordinate_decimals},
+                    m_path_quantum{0},
+                    m_gzip{detail::checked_gzip(detail::is_gzip_filename(filename))},
+                    m_streaming{false},
+                    m_frame_written{false}
 
     {
-        m_fs.open(filename);
 
         m_margin_top = 40;
         if (title == "") {
@@ -60,40 +70,74 @@ public:
 
     }
 
-    void add_dataset(std::vector<std::pair<Real, Real>> const & v, bool connect_the_dots = false,
-                     std::string dot_color = "steelblue", std::string connect_color="orange")
+    // Streaming: with the axes fixed up front, each dataset is written as it is added and no data is retained,
+    // so a view passed to add_dataset need only live for the call. Points outside the axes run off the graph.
+    // The document is still built in memory, but a dataset of more than detail::default_decimation_threshold points
+    // adds at most one dot per pixel, and for points ordered by x, at most four path points per pixel column.
+    scatter_plot(fixed_axes<Real> const & axes,
+                 std::string const & title,
+                 std::string const & filename,
+                 std::string const & x_label = "",
+                 std::string const & y_label = "",
+                 int width = 1100) :
+                    scatter_plot(title, filename, x_label, y_label, width)
     {
-        if (m_is_written)
+        axes.check();
+        m_min_x = axes.x_min;
+        m_max_x = axes.x_max;
+        m_min_y = axes.y_min;
+        m_max_y = axes.y_max;
+        m_streaming = true;
+    }
+
+    // Decimals written for screen coordinates; the default, 2, is 0.01px.
+    void set_coordinate_decimals(int decimals)
+    {
+        m_coordinate_decimals = detail::checked_coordinate_decimals(decimals);
+    }
+
+    // Write paths as relative l/h/v steps on a grid of quantum_px pixels, with duplicate points dropped.
+    // Typically 2-4x smaller than the default absolute coordinates.
+    void set_compact_paths(bool compact, double quantum_px = 0.1)
+    {
+        if (compact && !(quantum_px > 0))
         {
-            throw std::logic_error("Cannot add data to graph after writing it.\n");
+            throw std::domain_error("The path quantum must be positive; requested " + std::to_string(quantum_px));
         }
+        m_path_quantum = compact ? quantum_px : 0;
+    }
 
-        for (auto p : v)
-        {
-            if (p.first < m_min_x)
-            {
-                m_min_x = p.first;
-            }
-            if (p.first > m_max_x)
-            {
-                m_max_x = p.first;
-            }
+    // Write gzip-compressed SVG. On by default for .svgz and .svg.gz filenames. Requires QUICKSVG_HAS_ZLIB.
+    void set_gzip(bool gzip)
+    {
+        m_gzip = detail::checked_gzip(gzip);
+    }
 
-            if (p.second < m_min_y)
-            {
-                 m_min_y = p.second;
-            }
-            if (p.second > m_max_y)
-            {
-                m_max_y = p.second;
-            }
-        }
+    void add_dataset(std::vector<std::pair<Real, Real>> const & v, bool connect_the_dots = false,
+                     std::string dot_color = "steelblue", std::string connect_color="orange")
+    {
+        add_view(detail::dataset_view<std::pair<Real, Real>>(std::vector<std::pair<Real, Real>>(v)), connect_the_dots, connect_color, dot_color);
+    }
 
-        m_connect.push_back(connect_the_dots);
-        m_connect_color.push_back(connect_color);
-        m_dot_color.push_back(dot_color);
-        m_dataset.push_back(v);
+    // Moves v into the plot rather than copying it.
+    void add_dataset(std::vector<std::pair<Real, Real>> && v, bool connect_the_dots = false,
+                     std::string dot_color = "steelblue", std::string connect_color="orange")
+    {
+        add_view(detail::dataset_view<std::pair<Real, Real>>(std::move(v)), connect_the_dots, connect_color, dot_color);
+    }
+
+    // Shares v with the caller; nothing is copied.
+    void add_dataset(std::shared_ptr<std::vector<std::pair<Real, Real>> const> v, bool connect_the_dots = false,
+                     std::string dot_color = "steelblue", std::string connect_color="orange")
+    {
+        add_view(detail::dataset_view<std::pair<Real, Real>>(std::move(v)), connect_the_dots, connect_color, dot_color);
+    }
 
+    // Views the size samples at data without copying them. They must stay alive and unchanged until write_all().
+    void add_dataset(std::pair<Real, Real> const * data, size_t size, bool connect_the_dots = false,
+                     std::string dot_color = "steelblue", std::string connect_color="orange")
+    {
+        add_view(detail::dataset_view<std::pair<Real, Real>>(data, size), connect_the_dots, connect_color, dot_color);
     }
 
     void write_all()
@@ -102,17 +146,64 @@ public:
         {
             throw std::logic_error("Data is already written to the svg.\n");
         }
-        // Maps [a,b] to [0, graph_width]
-        auto x_scale = [this](Real x)->Real
+
+        size_t bytes = 4096;
+        for (auto const & v : m_dataset)
+        {
+            bytes += 128 + 80*v.size();
+        }
+        if (m_gzip)
+        {
+            m_fs.start_gzip();
+        }
+        m_fs.reserve(bytes);
+        write_frame();
+        for (size_t i = 0; i < m_connect.size(); ++i)
         {
-            return ((x-m_min_x)/(m_max_x- m_min_x))*static_cast<Real>(m_graph_width);
-        };
+            write_dataset(m_dataset[i], m_connect[i], m_connect_color[i], m_dot_color[i]);
+        }
+
+        m_fs << "</g>\n"
+           << "</svg>\n";
+        m_fs.commit(m_filename);
+
+        m_is_written = true;
 
-        auto y_scale = [this](Real y)-> Real
+    }
+
+    ~scatter_plot()
+    {
+        if (!m_is_written)
         {
-          return ((m_max_y - y)/(m_max_y - m_min_y) )*static_cast<Real>(m_graph_height);
-        };
+            std::cerr << "Warning: You did not write your data to disk!\n";
+        }
+    }
 
+private:
+    // Maps [a,b] to [0, graph_width]
+    Real x_scale(Real x) const
+    {
+        return ((x-m_min_x)/(m_max_x- m_min_x))*static_cast<Real>(m_graph_width);
+    }
+
+    Real y_scale(Real y) const
+    {
+        return ((m_max_y - y)/(m_max_y - m_min_y) )*static_cast<Real>(m_graph_height);
+    }
+
+    // The axes and gridlines, written once, as soon as the ranges are known.
+    void write_frame()
+    {
+        if (m_frame_written)
+        {
+            return;
+        }
+        m_frame_written = true;
+        if (m_gzip)
+        {
+            m_fs.start_gzip();
+        }
+        m_fs << detail::coordinate_decimals{m_coordinate_decimals};
           // Construct SVG group to simplify the calculations slightly:
         m_fs << "<g transform='translate(" << m_margin_left << ", " << m_margin_top << ")'>\n";
              // y-axis:
@@ -125,57 +216,112 @@ public:
         {
             x_axis_loc = y_scale(0);
         }
-        m_fs << "<line x1='0' y1='" << x_axis_loc
-             << "' x2='" << m_graph_width << "' y2='" << x_axis_loc
+        m_fs << "<line x1='0' y1='" << detail::coordinate(x_axis_loc)
+             << "' x2='" << m_graph_width << "' y2='" << detail::coordinate(x_axis_loc)
              << "' stroke='gray' stroke-width='1' />\n";
 
-        detail::write_gridlines(m_fs, 8, 10, x_scale, y_scale, m_min_x, m_max_x,
-                                m_min_y, m_max_y, m_graph_width, m_graph_height, m_margin_left);
-
+        detail::write_gridlines(m_fs, 8, 10, [this](Real x) { return x_scale(x); }, [this](Real y) { return y_scale(y); },
+                                m_min_x, m_max_x, m_min_y, m_max_y, m_graph_width, m_graph_height, m_margin_left);
+    }
 
-        for (size_t i = 0; i < m_connect.size(); ++i)
+    // Streaming, a dataset past the decimation threshold is bounded by the picture rather than by its size:
+    // the path keeps the M4 points of each run of consecutive points in one pixel column, which bounds it when the
+    // points are ordered by x, and each pixel of the canvas gets at most one dot.
+    void write_dataset(detail::dataset_view<std::pair<Real, Real>> const & v, bool connect_the_dots,
+                       std::string const & stroke, std::string const & dot_color)
+    {
+        if(connect_the_dots && m_streaming)
         {
-            bool connect_the_dots = m_connect[i];
-            auto const & v = m_dataset[i];
-            std::string const & stroke = m_connect_color[i];
-            std::string const & dot_color = m_dot_color[i];
-            if(connect_the_dots)
+            detail::m4_stream points;
+            for (auto const & p : v)
+            {
+                points.push(static_cast<double>(x_scale(p.first)), static_cast<double>(y_scale(p.second)));
+            }
+            std::vector<double> t;
+            std::vector<double> y;
+            points.finish(t, y);
+            if (!t.empty())
             {
-                m_fs << "<path d='M" << x_scale(v[0].first) << " " << y_scale(v[0].second);
-                for (size_t j = 1; j < v.size(); ++j)
-                {
-                    Real t = x_scale(v[j].first);
-                    m_fs << " L" << t << " " << y_scale(v[j].second);
-                }
+                m_fs << "<path d='";
+                detail::write_path_points(m_fs, t, y, t.size(), 0, m_path_quantum);
                 m_fs << "' stroke='" << stroke << "' stroke-width='3' fill='none'></path>\n";
             }
-
+        }
+        else if(connect_the_dots)
+        {
+            std::vector<Real> t(v.size());
+            std::vector<Real> y(v.size());
             for (size_t j = 0; j < v.size(); ++j)
             {
-                Real t = x_scale(v[j].first);
-                m_fs << "<circle cx='" << t << "' cy='" << y_scale(v[j].second)
-                     << "' r='1' fill='" << dot_color << "' />\n";
+                t[j] = x_scale(v[j].first);
+                y[j] = y_scale(v[j].second);
             }
+            m_fs << "<path d='";
+            // The abscissas are in no particular order, so the path is never decimated:
+            detail::write_path_points(m_fs, t, y, t.size(), 0, m_path_quantum);
+            m_fs << "' stroke='" << stroke << "' stroke-width='3' fill='none'></path>\n";
         }
 
-        m_fs << "</g>\n"
-           << "</svg>\n";
-        m_fs.close();
-
-        m_is_written = true;
-
+        bool thin = m_streaming && v.size() > detail::default_decimation_threshold;
+        detail::pixel_occupancy occupied(-m_margin_left, -m_margin_top,
+                                         thin ? m_margin_left + m_graph_width + m_margin_right : 0,
+                                         thin ? m_margin_top + m_graph_height + m_margin_bottom : 0);
+        for (size_t j = 0; j < v.size(); ++j)
+        {
+            Real t = x_scale(v[j].first);
+            Real y = y_scale(v[j].second);
+            if (thin && !occupied.claim(static_cast<double>(t), static_cast<double>(y)))
+            {
+                continue;
+            }
+            m_fs << "<circle cx='" << detail::coordinate(t) << "' cy='" << detail::coordinate(y)
+                 << "' r='1' fill='" << dot_color << "' />\n";
+        }
     }
 
-    ~scatter_plot()
+    void add_view(detail::dataset_view<std::pair<Real, Real>> v, bool connect_the_dots, std::string connect_color, std::string dot_color)
     {
-        if (!m_is_written)
+        if (m_is_written)
         {
-            std::cerr << "Warning: You did not write your data to disk!\n";
+            throw std::logic_error("Cannot add data to graph after writing it.\n");
         }
+        if (m_streaming)
+        {
+            write_frame();
+            write_dataset(v, connect_the_dots, connect_color, dot_color);
+            return;
+        }
+
+        for (auto const & p : v)
+        {
+            if (p.first < m_min_x)
+            {
+                m_min_x = p.first;
+            }
+            if (p.first > m_max_x)
+            {
+                m_max_x = p.first;
+            }
+
+            if (p.second < m_min_y)
+            {
+                 m_min_y = p.second;
+            }
+            if (p.second > m_max_y)
+            {
+                m_max_y = p.second;
+            }
+        }
+
+        m_connect.push_back(connect_the_dots);
+        m_connect_color.push_back(connect_color);
+        m_dot_color.push_back(dot_color);
+        m_dataset.push_back(std::move(v));
+
     }
 
-private:
-    std::ofstream m_fs;
+    std::string m_filename;
+    detail::svg_document m_fs;
     Real m_min_x;
     Real m_max_x;
     Real m_min_y;
@@ -183,7 +329,7 @@ private:
     bool m_is_written;
     std::vector<bool> m_connect;
     // Should be a list:
-    std::vector<std::vector<std::pair<Real, Real>>> m_dataset;
+    std::vector<detail::dataset_view<std::pair<Real, Real>>> m_dataset;
     std::vector<std::string> m_connect_color;
     std::vector<std::string> m_dot_color;
     int m_margin_top;
@@ -192,6 +338,11 @@ private:
     int m_margin_right;
     int m_graph_width;
     int m_graph_height;
+    int m_coordinate_decimals;
+    double m_path_quantum;
+    bool m_gzip;
+    bool m_streaming;
+    bool m_frame_written;
 };
 
 } // namespace
@@ -1,18 +1,29 @@
 #ifndef QUICKSVG_ULP_PLOT_HPP
 #define QUICKSVG_ULP_PLOT_HPP
 #include "detail/generic_svg_functionality.hpp"
+#include "detail/ulp_svg.hpp"
+#include "ulp_stats.hpp"
+#include "detail/parallel.hpp"
+#include "detail/reference_cache.hpp"
+#include "detail/sampling.hpp"
+#include "detail/batch.hpp"
+#include "detail/svg_document.hpp"
 #include <algorithm>
 #include <iomanip>
 #include <cassert>
 #include <vector>
 #include <utility>
-#include <fstream>
 #include <string>
-#include <list>
+#include <sstream>
+#include <typeinfo>
+#include <functional>
 #include <random>
+#include <cstdint>
+#include <type_traits>
 #if defined __has_include
 #  if __has_include (<boost/math/tools/condition_numbers.hpp>)
 #    include <boost/math/tools/condition_numbers.hpp>
+#    include <boost/math/special_functions/next.hpp>
 #    include <boost/random/uniform_real_distribution.hpp>
 #  else
 #    error "This library requires boost math 1.70 or above"
@@ -25,86 +36,87 @@
 
 // The envelope is the condition number of function evaluation.
 
+// The reference implementation is evaluated on `threads` threads (0 = hardware concurrency),
+// so hi_acc_impl must be safe to call concurrently; pass threads = 1 if it is not.
+// With a reference_cache and a fixed random_seed, the abscissas, reference values and condition numbers
+// are read from disk when an earlier run used the same parameters, and hi_acc_impl is never called.
+
 namespace quicksvg {
 
+// How the abscissas of a ulp_plot are drawn from [a, b]:
+//   random_sorted: i.i.d. uniform draws, then sorted. O(n log n) comparisons of PreciseReal.
+//   order_statistics: sorted uniform order statistics generated directly in O(n) from cumulative exponential
+//                     spacings, with a counter-based generator so generation is split across threads.
+//   stratified: one jittered sample in each of `samples` equal sub-intervals; no gaps, so fewer samples cover every pixel column.
+//   low_discrepancy: randomly shifted van der Corput (1D Sobol) points.
+//   ulp_uniform: uniform over the representable CoarseReal values in [a, b], for intervals spanning many binades.
+//                Requires CoarseReal to be float or double.
+enum class abscissa_sampling { random_sorted, order_statistics, stratified, low_discrepancy, ulp_uniform };
+
+// Faster reference types to try, in order, before PreciseReal; see the tiered ulp_plot constructor.
+template<class... Reals>
+struct precision_tiers {};
+
+// Where the condition number envelope is evaluated: at every sample, or on a pixel-resolution grid at write time.
+enum class envelope_resolution { per_sample, per_pixel };
+
 template<class F, typename PreciseReal, typename CoarseReal>
 class ulp_plot {
 public:
     ulp_plot(F hi_acc_impl, CoarseReal a, CoarseReal b,
-             bool perturb_abscissas = true, size_t samples = 10000, int random_seed = -1)
+             bool perturb_abscissas = true, size_t samples = 10000, int random_seed = -1, unsigned threads = 0,
+             reference_cache const & cache = reference_cache()) :
+        ulp_plot(hi_acc_impl, a, b, abscissa_sampling::random_sorted, perturb_abscissas, samples, random_seed, threads, cache)
     {
-        static_assert(sizeof(PreciseReal) >= sizeof(CoarseReal), "PreciseReal must have larger size than CoarseReal");
-        if (samples < 10)
-        {
-            throw std::domain_error("Must have at least 10 samples, samples = " + std::to_string(samples));
-        }
-        if (b <= a)
-        {
-            throw std::domain_error("On interval [a,b], b > a is required.");
-        }
-        a_ = a;
-        b_ = b;
+    }
 
-        std::mt19937_64 gen;
-        if (random_seed == -1)
-        {
-            std::random_device rd;
-            gen.seed(rd());
-        }
-        // Boost's uniform_real_distribution can generate quad and multiprecision random numbers; std's cannot:
-        boost::random::uniform_real_distribution<PreciseReal> dis(a, b);
-        precise_abscissas_.resize(samples);
-        coarse_abscissas_.resize(samples);
+    ulp_plot(F hi_acc_impl, CoarseReal a, CoarseReal b, abscissa_sampling sampling,
+             bool perturb_abscissas = true, size_t samples = 10000, int random_seed = -1, unsigned threads = 0,
+             reference_cache const & cache = reference_cache()) :
+        hi_acc_impl_{hi_acc_impl}
+    {
+        initialize(a, b, sampling, perturb_abscissas, samples, random_seed, threads, cache, "reference",
+                   [this]() { evaluate_reference(); });
+    }
 
-        if (perturb_abscissas)
-        {
-            for(size_t i = 0; i < samples; ++i)
-            {
-                precise_abscissas_[i] = dis(gen);
-            }
-            std::sort(precise_abscissas_.begin(), precise_abscissas_.end());
-            for (size_t i = 0; i < samples; ++i)
-            {
-                coarse_abscissas_[i] = static_cast<CoarseReal>(precise_abscissas_[i]);
-            }
-        }
-        else
-        {
-            for(size_t i = 0; i < samples; ++i)
-            {
-                coarse_abscissas_[i] = static_cast<CoarseReal>(dis(gen));
-            }
-            std::sort(coarse_abscissas_.begin(), coarse_abscissas_.end());
-            for (size_t i = 0; i < samples; ++i)
-            {
-                precise_abscissas_[i] = coarse_abscissas_[i];
-            }
-        }
+    // With the derivative of the reference, the condition number |x f'(x)/f(x)| costs one call of hi_acc_derivative
+    // per point instead of the several calls of hi_acc_impl made by numerical differentiation.
+    ulp_plot(F hi_acc_impl, std::function<PreciseReal(PreciseReal)> hi_acc_derivative, CoarseReal a, CoarseReal b,
+             abscissa_sampling sampling = abscissa_sampling::random_sorted, bool perturb_abscissas = true,
+             size_t samples = 10000, int random_seed = -1, unsigned threads = 0,
+             reference_cache const & cache = reference_cache()) :
+        hi_acc_impl_{hi_acc_impl},
+        hi_acc_derivative_{hi_acc_derivative}
+    {
+        // Cached condition numbers depend on how they were computed, so this is part of the cache key:
+        initialize(a, b, sampling, perturb_abscissas, samples, random_seed, threads, cache, "derivative",
+                   [this]() { evaluate_reference(); });
+    }
 
-        precise_ordinates_.resize(samples);
-        for (size_t i = 0; i < samples; ++i)
-        {
-            precise_ordinates_[i] = hi_acc_impl(precise_abscissas_[i]);
-        }
+    // Tiered reference: each sample is evaluated in the faster types Tiers... in turn, and only moves on to the next one
+    // (finally PreciseReal) when the condition number says the result may be off by more than 1/1024 ULP of CoarseReal,
+    // or it is zero or not finite. hi_acc_impl must accept every tier type, e.g., a generic lambda.
+    template<class... Tiers>
+    ulp_plot(F hi_acc_impl, precision_tiers<Tiers...>, CoarseReal a, CoarseReal b,
+             abscissa_sampling sampling = abscissa_sampling::random_sorted, bool perturb_abscissas = true,
+             size_t samples = 10000, int random_seed = -1, unsigned threads = 0,
+             reference_cache const & cache = reference_cache()) :
+        hi_acc_impl_{hi_acc_impl}
+    {
+        initialize(a, b, sampling, perturb_abscissas, samples, random_seed, threads, cache, tiers_mode<Tiers...>(),
+                   [this]() { evaluate_tiered_reference<Tiers...>(); });
+    }
 
-        cond_.resize(samples, std::numeric_limits<PreciseReal>::quiet_NaN());
-        for (size_t i = 0 ; i < samples; ++i)
-        {
-            PreciseReal y = precise_ordinates_[i];
-            if (y != 0)
-            {
-                cond_[i] = boost::math::tools::evaluation_condition_number(hi_acc_impl, precise_abscissas_[i]);
-                // Half-ULP accuracy is the correctly rounded result, so make sure the envelop doesn't go below this:
-                if (cond_[i] < 0.5)
-                {
-                    cond_[i] = 0.5;
-                }
-            }
-            // else leave it as nan.
-        }
-        clip_ = -1;
-        width_ = 1100;
-        envelope_color_ = "chartreuse";
+    // A plot for another coarse type that shares this plot's reference data and settings, but none of its functions.
+    // The abscissas and reference values are copied, not recomputed, so float, double and long double implementations
+    // can all be scored against a single reference run. Without perturbed abscissas the reference must be exactly at
+    // the coarse abscissas, so samples that OtherCoarseReal cannot represent are rounded and evaluated again.
+    // Condition numbers are copied only if this plot has computed them: a tiered reference computes them up front,
+    // and otherwise they are computed by the first write() with a per-sample envelope, or loaded from the cache.
+    template<typename OtherCoarseReal>
+    ulp_plot<F, PreciseReal, OtherCoarseReal> with_coarse_type() const
+    {
+        return ulp_plot<F, PreciseReal, OtherCoarseReal>(*this);
     }
 
     void set_clip(int clip)
@@ -117,37 +129,132 @@ public:
         width_ = width;
     }
 
+    // Decimals written for screen coordinates; the default, 2, is 0.01px.
+    void set_coordinate_decimals(int decimals)
+    {
+        coordinate_decimals_ = detail::checked_coordinate_decimals(decimals);
+    }
+
+    // Write envelope paths as relative l/h/v steps on a grid of quantum_px pixels, with duplicate points dropped.
+    // Typically 2-4x smaller than the default absolute coordinates.
+    void set_compact_paths(bool compact, double quantum_px = 0.1)
+    {
+        if (compact && !(quantum_px > 0))
+        {
+            throw std::domain_error("The path quantum must be positive; requested " + std::to_string(quantum_px));
+        }
+        path_quantum_ = compact ? quantum_px : 0;
+    }
+
+    // Write gzip-compressed SVG, as is always done for .svgz and .svg.gz filenames. Requires QUICKSVG_HAS_ZLIB.
+    void set_gzip(bool gzip)
+    {
+        gzip_ = detail::checked_gzip(gzip);
+    }
+
     void set_envelope_color(std::string const & color)
     {
         envelope_color_ = color;
     }
 
+    // per_pixel evaluates the condition number once per pixel column at write time, bisecting further where it jumps
+    // or where the function has a zero, pole, or NaN gap, instead of once per sample.
+    void set_envelope_resolution(envelope_resolution resolution)
+    {
+        envelope_resolution_ = resolution;
+    }
+
+    // Draw a density-shaded cloud per pixel column instead of one circle per sample.
+    // Recommended above a few thousand samples, where the per-sample output gets too large for browsers to render.
+    void set_aggregate_columns(bool aggregate)
+    {
+        aggregate_columns_ = aggregate;
+    }
+
+    // After each add_fn, search the neighbourhoods of the top_k worst samples for larger errors,
+    // spending at most evaluation_budget extra evaluations of the reference and of the function per add_fn.
+    // The search steps over representable CoarseReal values, so it calls hi_acc_impl even after a reference cache hit.
+    void set_refinement(size_t top_k, size_t evaluation_budget = 10000)
+    {
+        refine_top_k_ = top_k;
+        refine_budget_ = evaluation_budget;
+    }
+
+    // g is either a scalar callable, y = g(x), or a batch callable, g(x, y, n) with CoarseReal const * x and CoarseReal* y,
+    // which is handed the abscissas in chunks, so vectorized implementations can be measured as they are shipped.
     template<class G>
     void add_fn(G g, std::string const & color = "steelblue")
     {
-        using std::abs;
         size_t samples = precise_abscissas_.size();
-        std::vector<CoarseReal> ulps(samples);
+        size_t offset = ulps_.size();
+        ulps_.resize(offset + samples);
+        CoarseReal* ulps = ulps_.data() + offset;
+        ulp_stats<CoarseReal> stats;
+        std::vector<CoarseReal> coarse_y;
+        std::vector<PreciseReal> y_lo_acc(std::min(samples, detail::batch_chunk_size));
+        for (size_t begin = 0; begin < samples; begin += detail::batch_chunk_size)
+        {
+            size_t n = std::min(samples - begin, detail::batch_chunk_size);
+            if constexpr (detail::is_batch_callable<G, CoarseReal>::value)
+            {
+                coarse_y.resize(n);
+                g(coarse_abscissas_.data() + begin, coarse_y.data(), n);
+                std::copy(coarse_y.begin(), coarse_y.end(), y_lo_acc.begin());
+            }
+            else
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    y_lo_acc[i] = g(coarse_abscissas_[begin + i]);
+                }
+            }
+            detail::ulp_distances(precise_ordinates_.data() + begin, y_lo_acc.data(), ulps + begin, n);
+        }
         for (size_t i = 0; i < samples; ++i)
         {
-            PreciseReal y_hi_acc = precise_ordinates_[i];
-            PreciseReal y_lo_acc = g(coarse_abscissas_[i]);
-            PreciseReal absy = abs(y_hi_acc);
-            PreciseReal dist = nextafter(static_cast<CoarseReal>(absy), std::numeric_limits<CoarseReal>::max()) - static_cast<CoarseReal>(absy);
-            ulps[i] = static_cast<CoarseReal>((y_lo_acc - y_hi_acc)/dist);
+            stats.add(coarse_abscissas_[i], ulps[i]);
         }
-        ulp_list_.emplace_back(ulps);
+        stats_.emplace_back(stats);
+        worst_cases_.emplace_back(ulp_worst_case<CoarseReal>{stats.worst_abscissa, stats.worst});
         colors_.emplace_back(color);
+        if (refine_top_k_ > 0 && refine_budget_ > 0)
+        {
+            refine_worst_case(g, ulps, worst_cases_.back());
+        }
         return;
     }
 
+    size_t function_count() const
+    {
+        return stats_.size();
+    }
+
+    // tier_escalations()[k] is the number of samples that were not accurate enough in the k-th tier type.
+    // Empty unless the reference was computed by the tiered constructor (and not read from a cache).
+    std::vector<size_t> const & tier_escalations() const
+    {
+        return tier_escalations_;
+    }
+
+    // The input with the largest |ULP error| found for the i-th function added, including the refinement pass if enabled.
+    ulp_worst_case<CoarseReal> const & worst_case(size_t i = 0) const
+    {
+        return worst_cases_.at(i);
+    }
+
+    // Statistics of the i-th function added, available without writing the plot.
+    ulp_stats<CoarseReal> const & stats(size_t i = 0) const
+    {
+        return stats_.at(i);
+    }
+
     void write(std::string const & filename, bool ulp_envelope = true, std::string const & title = "",
                int horizontal_lines = 8, int vertical_lines = 10)
     {
         using std::abs;
         using std::floor;
         using std::isnan;
-        if (ulp_list_.size() == 0)
+        if (stats_.size() == 0)
         {
             throw std::domain_error("No functions added for comparison.");
         }
@@ -159,22 +266,22 @@ public:
         PreciseReal worst_ulp_distance = 0;
         PreciseReal min_y = std::numeric_limits<PreciseReal>::max();
         PreciseReal max_y = std::numeric_limits<PreciseReal>::lowest();
-        for (auto const & ulp_vec : ulp_list_)
+        for (auto const & worst : worst_cases_)
         {
-            for (auto const & ulp : ulp_vec)
+            if (abs(worst.ulp) > worst_ulp_distance)
             {
-                if (abs(ulp) > worst_ulp_distance)
-                {
-                    worst_ulp_distance = abs(ulp);
-                }
-                if (ulp < min_y)
-                {
-                    min_y = ulp;
-                }
-                if (ulp > max_y)
-                {
-                    max_y = ulp;
-                }
+                worst_ulp_distance = abs(worst.ulp);
+            }
+        }
+        for (auto const & stats : stats_)
+        {
+            if (stats.min < min_y)
+            {
+                min_y = stats.min;
+            }
+            if (stats.max > max_y)
+            {
+                max_y = stats.max;
             }
         }
 
@@ -190,18 +297,9 @@ public:
             }
         }
 
-        int height = floor(double(width_)/1.61803);
-        int margin_top = 40;
-        int margin_left = 25;
-        if (title.size() == 0)
-        {
-            margin_top = 10;
-            margin_left = 15;
-        }
-        int margin_bottom = 20;
-        int margin_right = 20;
-        int graph_height = height - margin_bottom - margin_top;
-        int graph_width = width_ - margin_left - margin_right;
+        detail::ulp_layout layout = detail::make_ulp_layout(width_, title.size() > 0);
+        int graph_height = layout.graph_height;
+        int graph_width = layout.graph_width;
 
         // Maps [a,b] to [0, graph_width]
         auto x_scale = [&](CoarseReal x)->CoarseReal
@@ -214,216 +312,585 @@ public:
             return ((max_y - y)/(max_y - min_y) )*static_cast<PreciseReal>(graph_height);
         };
 
-        std::ofstream fs;
-        fs.open(filename);
-        fs << "<?xml version=\"1.0\" encoding='UTF-8' ?>\n"
-           << "<svg xmlns='http://www.w3.org/2000/svg' width='"
-           << width_ << "' height='"
-           << height << "'>\n"
-           << "<style>svg { background-color: black; }\n"
-           << "</style>\n";
-        if (title.size() > 0)
-        {
-            fs << "<text x='" << floor(width_/2)
-               << "' y='" << floor(margin_top/2)
-               << "' font-family='Palatino' font-size='25' fill='white'  alignment-baseline='middle' text-anchor='middle'>"
-               << title
-               << "</text>\n";
-        }
-
-        // Construct SVG group to simplify the calculations slightly:
-        fs << "<g transform='translate(" << margin_left << ", " << margin_top << ")'>\n";
-            // y-axis:
-        fs  << "<line x1='0' y1='0' x2='0' y2='" << graph_height
-            << "' stroke='gray' stroke-width='1'/>\n";
-        PreciseReal x_axis_loc = y_scale(static_cast<PreciseReal>(0));
-        fs << "<line x1='0' y1='" << x_axis_loc
-            << "' x2='" << graph_width << "' y2='" << x_axis_loc
-            << "' stroke='gray' stroke-width='1'/>\n";
-
-        if (worst_ulp_distance > 3)
-        {
-            detail::write_gridlines(fs, horizontal_lines, vertical_lines, x_scale, y_scale, a_, b_,
-                                    static_cast<CoarseReal>(min_y), static_cast<CoarseReal>(max_y), graph_width, graph_height, margin_left);
-        }
-        else
+        size_t samples = coarse_abscissas_.size();
+        detail::svg_document fs;
+        if (gzip_ || detail::is_gzip_filename(filename))
         {
-            std::vector<double> ys{-3.0, -2.5, -2.0, -1.5, -1.0, -0.5, 0.5, 1.0, 1.5, 2.0, 2.5, 3.0};
-            for (size_t i = 0; i < ys.size(); ++i)
-            {
-                if (min_y <= ys[i] && ys[i] <= max_y)
-                {
-                    PreciseReal y_cord_dataspace = ys[i];
-                    PreciseReal y = y_scale(y_cord_dataspace);
-                    fs << "<line x1='0' y1='" << y << "' x2='" << graph_width
-                       << "' y2='" << y
-                       << "' stroke='gray' stroke-width='1' opacity='0.5' stroke-dasharray='4' />\n";
-
-                    fs << "<text x='" <<  -margin_left/2 << "' y='" << y - 3
-                       << "' font-family='times' font-size='10' fill='white' transform='rotate(-90 "
-                       << -margin_left/2 + 11 << " " << y + 5 << ")'>"
-                       <<  std::setprecision(4) << y_cord_dataspace << "</text>\n";
-                }
-            }
-            for (int i = 1; i <= vertical_lines; ++i)
-            {
-                CoarseReal x_cord_dataspace = a_ +  ((b_ - a_)*i)/vertical_lines;
-                CoarseReal x = x_scale(x_cord_dataspace);
-                fs << "<line x1='" << x << "' y1='0' x2='" << x
-                   << "' y2='" << graph_height
-                   << "' stroke='gray' stroke-width='1' opacity='0.5' stroke-dasharray='4' />\n";
-
-                fs << "<text x='" <<  x - 10  << "' y='" << graph_height + 10
-                   << "' font-family='times' font-size='10' fill='white'>"
-                   << std::setprecision(4) << x_cord_dataspace << "</text>\n";
-            }
+            fs.start_gzip();
         }
+        // About 56 bytes per circle, and 16 per envelope point on each side:
+        fs.reserve(4096 + (aggregate_columns_ ? 64*(graph_width + 1) : 56*samples)*stats_.size() + (ulp_envelope ? 32*samples : 0));
+        fs << detail::coordinate_decimals{coordinate_decimals_};
+        detail::write_ulp_frame(fs, layout, title, x_scale, y_scale, a_, b_, min_y, max_y, worst_ulp_distance,
+                                horizontal_lines, vertical_lines);
 
-        int color_idx = 0;
-        for (auto const & ulp : ulp_list_)
+        auto hidden = [this](CoarseReal ulp)
+        {
+            return isnan(ulp) || (clip_ > 0 && abs(ulp) > clip_);
+        };
+        for (size_t i = 0; i < stats_.size(); ++i)
         {
-            std::string color = colors_[color_idx++];
-            for (size_t j = 0; j < ulp.size(); ++j)
+            CoarseReal const * ulp = ulps_.data() + i*samples;
+            std::string const & color = colors_[i];
+            if (aggregate_columns_)
             {
-                if (isnan(ulp[j]))
+                detail::ulp_density density(graph_width, graph_height);
+                for (size_t j = 0; j < samples; ++j)
                 {
-                    continue;
+                    if (!hidden(ulp[j]))
+                    {
+                        density.add(static_cast<double>(x_scale(coarse_abscissas_[j])), static_cast<double>(y_scale(ulp[j])));
+                    }
                 }
-                if (clip_ > 0 && abs(ulp[j]) > clip_)
+                density.write(fs, color);
+                continue;
+            }
+            for (size_t j = 0; j < samples; ++j)
+            {
+                if (hidden(ulp[j]))
                 {
                     continue;
                 }
                 CoarseReal x = x_scale(coarse_abscissas_[j]);
                 PreciseReal y = y_scale(ulp[j]);
-                fs << "<circle cx='" << x << "' cy='" << y << "' r='1' fill='" << color << "'/>";
+                fs << "<circle cx='" << detail::coordinate(x) << "' cy='" << detail::coordinate(y) << "' r='1' fill='" << color << "'/>";
             }
         }
 
-        if (ulp_envelope)
+        if (ulp_envelope && envelope_resolution_ == envelope_resolution::per_pixel)
+        {
+            evaluate_pixel_envelope(graph_width);
+            detail::write_ulp_envelope(fs, pixel_envelope_abscissas_, pixel_envelope_cond_, clip_, envelope_color_, x_scale, y_scale, path_quantum_);
+        }
+        else if (ulp_envelope)
         {
             write_ulp_envelope(fs, x_scale, y_scale);
         }
         fs << "</g>\n"
            << "</svg>\n";
-        fs.close();
+        fs.commit(filename);
     }
 
-    void write_ulp_envelope(std::ofstream & fs, std::function<CoarseReal(CoarseReal)> x_scale, std::function<PreciseReal(PreciseReal)> y_scale)
+    void write_ulp_envelope(std::ostream & fs, std::function<CoarseReal(CoarseReal)> x_scale, std::function<PreciseReal(PreciseReal)> y_scale)
+    {
+        evaluate_condition_numbers();
+        detail::write_ulp_envelope(fs, coarse_abscissas_, cond_, clip_, envelope_color_, x_scale, y_scale, path_quantum_);
+    }
+
+private:
+    template<class, typename, typename> friend class ulp_plot;
+
+    template<typename OtherCoarseReal>
+    explicit ulp_plot(ulp_plot<F, PreciseReal, OtherCoarseReal> const & other) :
+        hi_acc_impl_{other.hi_acc_impl_}
     {
-        /*std::list<std::pair<size_t, size_t>> partitions;
-        size_t i = 0;
-        size_t imin = 0;
-        size_t imax = 0;
-        bool bad = isnan(cond_[0]) || (clip_ > 0 && cond_[0] > clip_);
-        bool looking_for_min = true;
-        while(i < cond_.size())
+        static_assert(sizeof(PreciseReal) >= sizeof(CoarseReal), "PreciseReal must have larger size than CoarseReal");
+        hi_acc_derivative_ = other.hi_acc_derivative_;
+        perturb_abscissas_ = other.perturb_abscissas_;
+        precise_abscissas_ = other.precise_abscissas_;
+        precise_ordinates_ = other.precise_ordinates_;
+        cond_ = other.cond_;
+        tier_escalations_ = other.tier_escalations_;
+        coarse_abscissas_.resize(precise_abscissas_.size());
+        for (size_t i = 0; i < precise_abscissas_.size(); ++i)
         {
-            if (isnan(cond_[i]) || (clip_ > 0 && cond_[i] > clip_))
-            {
-                ++i;
-            }
-            else
+            coarse_abscissas_[i] = static_cast<CoarseReal>(precise_abscissas_[i]);
+        }
+        a_ = static_cast<CoarseReal>(other.a_);
+        b_ = static_cast<CoarseReal>(other.b_);
+        threads_ = other.threads_;
+        if (!perturb_abscissas_)
+        {
+            // Only a narrower type moves any sample:
+            bool has_cond = cond_.size() == precise_abscissas_.size();
+            detail::parallel_for(precise_abscissas_.size(), threads_, [&](size_t i)
             {
-                if (looking_for_min)
+                PreciseReal x = coarse_abscissas_[i];
+                if (x == precise_abscissas_[i])
                 {
-                    imin = i;
-                    looking_for_min = false;
+                    return;
                 }
-                else
+                precise_abscissas_[i] = x;
+                precise_ordinates_[i] = hi_acc_impl_(x);
+                if (has_cond)
                 {
-                    imax = i;
-                    looking_for_min = false;
-                    partitions.emplace_back({imin, imax});
+                    cond_[i] = sample_condition_number(x, precise_ordinates_[i]);
                 }
-                ++i;
+            });
+        }
+        // The cache key names the original coarse type, so condition numbers computed from here on are not saved.
+        clip_ = other.clip_;
+        width_ = other.width_;
+        coordinate_decimals_ = other.coordinate_decimals_;
+        path_quantum_ = other.path_quantum_;
+        gzip_ = other.gzip_;
+        envelope_color_ = other.envelope_color_;
+        aggregate_columns_ = other.aggregate_columns_;
+        refine_top_k_ = other.refine_top_k_;
+        refine_budget_ = other.refine_budget_;
+        envelope_resolution_ = other.envelope_resolution_;
+        pixel_envelope_width_ = 0;
+    }
+
+    template<class Evaluate>
+    void initialize(CoarseReal a, CoarseReal b, abscissa_sampling sampling, bool perturb_abscissas, size_t samples,
+                    int random_seed, unsigned threads, reference_cache const & cache, std::string const & mode, Evaluate evaluate)
+    {
+        static_assert(sizeof(PreciseReal) >= sizeof(CoarseReal), "PreciseReal must have larger size than CoarseReal");
+        if (samples < 10)
+        {
+            throw std::domain_error("Must have at least 10 samples, samples = " + std::to_string(samples));
+        }
+        if (b <= a)
+        {
+            throw std::domain_error("On interval [a,b], b > a is required.");
+        }
+        a_ = a;
+        b_ = b;
+        threads_ = threads;
+        perturb_abscissas_ = perturb_abscissas;
+
+        if (cache.function_id.size() > 0)
+        {
+            if (random_seed == -1)
+            {
+                throw std::domain_error("A reference cache requires a fixed random_seed.");
             }
-        }*/
- 
-        std::string close_path = "' stroke='"  + envelope_color_ + "' stroke-width='1' fill='none'></path>\n";
-        size_t jstart = 0;
-        if (clip_ > 0)
+            cache_key_ = reference_cache_key(cache.function_id, mode, sampling, perturb_abscissas, samples, random_seed);
+            cache_file_ = detail::reference_cache_path(cache, cache_key_);
+        }
+
+        if (cache_file_.size() > 0 && detail::load_reference(cache_file_, cache_key_, samples, precise_abscissas_, precise_ordinates_, cond_))
         {
-            while (cond_[jstart] > clip_)
+            // The key names CoarseReal, so the cached abscissas were generated for it: perturbed, the coarse abscissas are
+            // the rounded precise ones, and unperturbed, the precise abscissas are CoarseReal values, which round exactly.
+            coarse_abscissas_.resize(samples);
+            for (size_t i = 0; i < samples; ++i)
             {
-                ++jstart;
-                if (jstart >= cond_.size())
-                {
-                    return;
-                }
+                coarse_abscissas_[i] = static_cast<CoarseReal>(precise_abscissas_[i]);
+            }
+        }
+        else
+        {
+            generate_abscissas(sampling, perturb_abscissas, samples, random_seed, threads);
+            evaluate();
+            if (cache_file_.size() > 0)
+            {
+                detail::save_reference(cache_file_, cache_key_, precise_abscissas_, precise_ordinates_, cond_);
             }
         }
-        size_t jmin = jstart;
-new_top_path:
-        if (jmin >= cond_.size())
+        clip_ = -1;
+        width_ = 1100;
+        coordinate_decimals_ = detail::default_coordinate_decimals;
+        path_quantum_ = 0;
+        gzip_ = false;
+        envelope_color_ = "chartreuse";
+        aggregate_columns_ = false;
+        refine_top_k_ = 0;
+        refine_budget_ = 0;
+        envelope_resolution_ = envelope_resolution::per_sample;
+        pixel_envelope_width_ = 0;
+    }
+
+    void generate_abscissas(abscissa_sampling sampling, bool perturb_abscissas, size_t samples, int random_seed, unsigned threads)
+    {
+        uint64_t seed = static_cast<uint64_t>(random_seed);
+        if (random_seed == -1)
         {
-            goto start_bottom_paths;
+            std::random_device rd;
+            seed = (static_cast<uint64_t>(rd()) << 32) | rd();
         }
-        fs << "<path d='M" << x_scale(coarse_abscissas_[jmin]) << " " << y_scale(cond_[jmin]);
+        precise_abscissas_.resize(samples);
+        coarse_abscissas_.resize(samples);
 
-        for (size_t j = jmin + 1; j < coarse_abscissas_.size(); ++j)
+        PreciseReal a = a_;
+        PreciseReal b = b_;
+        switch (sampling)
         {
-            bool bad = isnan(cond_[j]) || (clip_ > 0 && cond_[j] > clip_);
-            if (bad)
+        case abscissa_sampling::order_statistics:
+            detail::uniform_order_statistics(precise_abscissas_, a, b, seed, threads);
+            break;
+        case abscissa_sampling::stratified:
+            detail::stratified_uniform(precise_abscissas_, a, b, seed, threads);
+            break;
+        case abscissa_sampling::low_discrepancy:
+            detail::van_der_corput(precise_abscissas_, a, b, seed);
+            break;
+        case abscissa_sampling::ulp_uniform:
+            if constexpr (std::is_same<CoarseReal, float>::value || std::is_same<CoarseReal, double>::value)
+            {
+                detail::ulp_uniform(precise_abscissas_, a_, b_, seed, perturb_abscissas);
+                break;
+            }
+            throw std::domain_error("ulp_uniform sampling requires CoarseReal to be float or double.");
+        default:
+        {
+            std::mt19937_64 gen(seed);
+            // Boost's uniform_real_distribution can generate quad and multiprecision random numbers; std's cannot:
+            boost::random::uniform_real_distribution<PreciseReal> dis(a_, b_);
+            for(size_t i = 0; i < samples; ++i)
             {
-                ++j;
-                while ( (j < coarse_abscissas_.size() - 2) && bad)
+                precise_abscissas_[i] = dis(gen);
+            }
+            std::sort(precise_abscissas_.begin(), precise_abscissas_.end());
+        }
+        }
+
+        for (size_t i = 0; i < samples; ++i)
+        {
+            coarse_abscissas_[i] = static_cast<CoarseReal>(precise_abscissas_[i]);
+        }
+        if (!perturb_abscissas)
+        {
+            // Evaluate the reference at exactly the values the coarse implementation sees:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                precise_abscissas_[i] = coarse_abscissas_[i];
+            }
+        }
+    }
+
+    void evaluate_reference()
+    {
+        size_t samples = precise_abscissas_.size();
+        // Each sample is written by exactly one thread, so the result is the same for any thread count:
+        precise_ordinates_.resize(samples);
+        detail::parallel_for(samples, threads_, [&](size_t i)
+        {
+            precise_ordinates_[i] = hi_acc_impl_(precise_abscissas_[i]);
+        });
+    }
+
+    template<class... Tiers>
+    void evaluate_tiered_reference()
+    {
+        size_t samples = precise_abscissas_.size();
+        precise_ordinates_.resize(samples);
+        cond_.resize(samples);
+        std::vector<unsigned> tier(samples);
+        detail::parallel_for(samples, threads_, [&](size_t i)
+        {
+            tier[i] = evaluate_in_tiers<Tiers...>(i);
+        });
+        tier_escalations_.assign(sizeof...(Tiers), 0);
+        for (unsigned t : tier)
+        {
+            for (unsigned k = 0; k < t; ++k)
+            {
+                ++tier_escalations_[k];
+            }
+        }
+    }
+
+    // Evaluates sample i in the first tier accurate enough for it, and returns that tier's index.
+    template<class... Tiers>
+    unsigned evaluate_in_tiers(size_t i)
+    {
+        if constexpr (sizeof...(Tiers) == 0)
+        {
+            PreciseReal x = precise_abscissas_[i];
+            PreciseReal y = hi_acc_impl_(x);
+            precise_ordinates_[i] = y;
+            cond_[i] = std::numeric_limits<PreciseReal>::quiet_NaN();
+            if (y != 0)
+            {
+                cond_[i] = condition_number(x, y);
+                if (cond_[i] < 0.5)
                 {
-                    bad = isnan(cond_[j]) || (clip_ > 0 && cond_[j] > clip_);
-                    ++j;
+                    cond_[i] = 0.5;
                 }
-                jmin = j;
-                fs << close_path;
-                goto new_top_path;
             }
+            return 0;
+        }
+        else
+        {
+            return evaluate_in_tier<Tiers...>(i);
+        }
+    }
 
-            CoarseReal t = x_scale(coarse_abscissas_[j]);
-            PreciseReal y = y_scale(cond_[j]);
-            fs << " L" << t << " " << y;
+    template<class Tier, class... Rest>
+    unsigned evaluate_in_tier(size_t i)
+    {
+        using std::isfinite;
+        Tier x = static_cast<Tier>(precise_abscissas_[i]);
+        Tier y = hi_acc_impl_(x);
+        if (y != 0 && isfinite(y))
+        {
+            Tier cond = boost::math::tools::evaluation_condition_number(hi_acc_impl_, x);
+            // The error of y is about cond*eps(Tier) from rounding x, plus a few eps(Tier) from the evaluation:
+            if (isfinite(cond) && (cond + 4)*std::numeric_limits<Tier>::epsilon()*1024 <= std::numeric_limits<CoarseReal>::epsilon())
+            {
+                precise_ordinates_[i] = static_cast<PreciseReal>(y);
+                cond_[i] = cond < 0.5 ? PreciseReal(0.5) : static_cast<PreciseReal>(cond);
+                return 0;
+            }
         }
-        fs << close_path;
-start_bottom_paths:
-        jmin = jstart;
-new_bottom_path:
-        if (jmin >= cond_.size())
+        return 1 + evaluate_in_tiers<Rest...>(i);
+    }
+
+    // Condition numbers at the samples are only needed for a per-sample envelope, so they are computed on first use,
+    // and added to the reference cache if there is one.
+    void evaluate_condition_numbers()
+    {
+        size_t samples = precise_abscissas_.size();
+        if (cond_.size() == samples)
         {
             return;
         }
-        fs << "<path d='M" << x_scale(coarse_abscissas_[jmin]) << " " << y_scale(-cond_[jmin]);
+        cond_.resize(samples, std::numeric_limits<PreciseReal>::quiet_NaN());
+        detail::parallel_for(samples, threads_, [&](size_t i)
+        {
+            cond_[i] = sample_condition_number(precise_abscissas_[i], precise_ordinates_[i]);
+        });
+        if (cache_file_.size() > 0)
+        {
+            detail::save_reference(cache_file_, cache_key_, precise_abscissas_, precise_ordinates_, cond_);
+        }
+    }
+
+    // The envelope at a sample, or nan where y = hi_acc_impl(x) is zero.
+    PreciseReal sample_condition_number(PreciseReal const & x, PreciseReal const & y)
+    {
+        if (y == 0)
+        {
+            return std::numeric_limits<PreciseReal>::quiet_NaN();
+        }
+        PreciseReal cond = condition_number(x, y);
+        // Half-ULP accuracy is the correctly rounded result, so make sure the envelop doesn't go below this:
+        return cond < 0.5 ? PreciseReal(0.5) : cond;
+    }
+
+    // y = hi_acc_impl(x) != 0.
+    PreciseReal condition_number(PreciseReal const & x, PreciseReal const & y)
+    {
+        using std::abs;
+        if (hi_acc_derivative_)
+        {
+            return abs(x*hi_acc_derivative_(x)/y);
+        }
+        return boost::math::tools::evaluation_condition_number(hi_acc_impl_, x);
+    }
+
+    PreciseReal pixel_condition_number(CoarseReal x)
+    {
+        using std::isfinite;
+        PreciseReal y = hi_acc_impl_(static_cast<PreciseReal>(x));
+        if (y == 0 || !isfinite(y))
+        {
+            return std::numeric_limits<PreciseReal>::quiet_NaN();
+        }
+        PreciseReal cond = condition_number(static_cast<PreciseReal>(x), y);
+        if (!isfinite(cond))
+        {
+            return std::numeric_limits<PreciseReal>::quiet_NaN();
+        }
+        return cond < 0.5 ? PreciseReal(0.5) : cond;
+    }
+
+    // Samples the condition number at the graph_width + 1 pixel boundaries, then bisects (up to 2^-8 pixel)
+    // every pixel where the envelope is cut by a NaN or changes by more than a factor of two.
+    void evaluate_pixel_envelope(int graph_width)
+    {
+        using std::isnan;
+        if (pixel_envelope_width_ == graph_width)
+        {
+            return;
+        }
+        size_t points = graph_width + 1;
+        std::vector<CoarseReal> grid(points);
+        std::vector<PreciseReal> grid_cond(points);
+        for (size_t j = 0; j < points; ++j)
+        {
+            grid[j] = j + 1 == points ? b_ : static_cast<CoarseReal>(a_ + (PreciseReal(b_) - PreciseReal(a_))*j/graph_width);
+        }
+        detail::parallel_for(points, threads_, [&](size_t j)
+        {
+            grid_cond[j] = pixel_condition_number(grid[j]);
+        });
+
+        auto steep = [](PreciseReal c0, PreciseReal c1)
+        {
+            if (isnan(c0) || isnan(c1))
+            {
+                return isnan(c0) != isnan(c1);
+            }
+            return c0 > 2*c1 || c1 > 2*c0;
+        };
+        pixel_envelope_abscissas_.clear();
+        pixel_envelope_cond_.clear();
+        std::function<void(CoarseReal, PreciseReal, CoarseReal, PreciseReal, int)> bisect =
+            [&](CoarseReal x0, PreciseReal c0, CoarseReal x1, PreciseReal c1, int depth)
+        {
+            CoarseReal mid = x0 + (x1 - x0)/2;
+            if (depth == 0 || !steep(c0, c1) || mid <= x0 || mid >= x1)
+            {
+                return;
+            }
+            PreciseReal c = pixel_condition_number(mid);
+            bisect(x0, c0, mid, c, depth - 1);
+            pixel_envelope_abscissas_.push_back(mid);
+            pixel_envelope_cond_.push_back(c);
+            bisect(mid, c, x1, c1, depth - 1);
+        };
+        for (size_t j = 0; j < points; ++j)
+        {
+            if (j > 0)
+            {
+                bisect(grid[j - 1], grid_cond[j - 1], grid[j], grid_cond[j], 8);
+            }
+            pixel_envelope_abscissas_.push_back(grid[j]);
+            pixel_envelope_cond_.push_back(grid_cond[j]);
+        }
+        pixel_envelope_width_ = graph_width;
+    }
 
-        for (size_t j = jmin + 1; j < coarse_abscissas_.size(); ++j)
+    // Compass search from each of the top-k samples: try the representable values `stride` ULPs to either side,
+    // move to the better one, and halve the stride when neither improves. Starts at half the gap to the adjacent samples.
+    template<class G>
+    void refine_worst_case(G & g, CoarseReal const * ulps, ulp_worst_case<CoarseReal> & worst)
+    {
+        using std::abs;
+        using std::isnan;
+        using boost::math::float_advance;
+        using boost::math::float_distance;
+        size_t samples = coarse_abscissas_.size();
+        std::vector<size_t> candidates;
+        for (size_t i = 0; i < samples; ++i)
         {
-            bool bad = isnan(cond_[j]) || (clip_ > 0 && cond_[j] > clip_);
-            if (bad)
+            if (!isnan(ulps[i]))
             {
-                ++j;
-                while ( (j < coarse_abscissas_.size() - 2) && bad)
+                candidates.push_back(i);
+            }
+        }
+        size_t k = std::min(refine_top_k_, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end(), [&](size_t i, size_t j)
+        {
+            return abs(ulps[i]) > abs(ulps[j]) || (abs(ulps[i]) == abs(ulps[j]) && i < j);
+        });
+
+        auto ulp_error = [&](CoarseReal x)
+        {
+            PreciseReal y_lo_acc = detail::evaluate_at(g, x);
+            return detail::ulp_distance<CoarseReal>(hi_acc_impl_(static_cast<PreciseReal>(x)), y_lo_acc);
+        };
+        // Whole number of ULPs from x to y, capped so it fits float_advance's int argument:
+        auto ulps_between = [](CoarseReal x, CoarseReal y)->int64_t
+        {
+            using std::floor;
+            CoarseReal d = abs(float_distance(x, y));
+            return d > CoarseReal(1 << 30) ? int64_t(1) << 30 : static_cast<int64_t>(floor(d));
+        };
+
+        for (size_t c = 0; c < k; ++c)
+        {
+            size_t i = candidates[c];
+            size_t evaluations = refine_budget_/k + (c < refine_budget_ % k);
+            CoarseReal best_x = coarse_abscissas_[i];
+            CoarseReal best = ulps[i];
+            int64_t gap = int64_t(1) << 30;
+            if (i > 0)
+            {
+                gap = std::min(gap, ulps_between(coarse_abscissas_[i - 1], best_x));
+            }
+            if (i + 1 < samples)
+            {
+                gap = std::min(gap, ulps_between(best_x, coarse_abscissas_[i + 1]));
+            }
+            int64_t stride = 1;
+            while (2*stride <= gap/2)
+            {
+                stride *= 2;
+            }
+
+            while (stride >= 1 && evaluations > 0)
+            {
+                bool moved = false;
+                for (int direction : {1, -1})
+                {
+                    CoarseReal bound = direction > 0 ? b_ : a_;
+                    int64_t step = std::min(stride, ulps_between(best_x, bound));
+                    if (step == 0 || evaluations == 0)
+                    {
+                        continue;
+                    }
+                    CoarseReal x = float_advance(best_x, static_cast<int>(direction*step));
+                    CoarseReal ulp = ulp_error(x);
+                    --evaluations;
+                    if (!isnan(ulp) && abs(ulp) > abs(best))
+                    {
+                        best = ulp;
+                        best_x = x;
+                        moved = true;
+                        break;
+                    }
+                }
+                if (!moved)
                 {
-                    bad = isnan(cond_[j]) || (clip_ > 0 && cond_[j] > clip_);
-                    ++j;
+                    stride /= 2;
                 }
-                jmin = j;
-                fs << close_path;
-                goto new_bottom_path;
             }
-            CoarseReal t = x_scale(coarse_abscissas_[j]);
-            PreciseReal y = y_scale(-cond_[j]);
-            fs << " L" << t << " " << y;
+
+            if (abs(best) > abs(worst.ulp))
+            {
+                worst.abscissa = best_x;
+                worst.ulp = best;
+            }
         }
-        fs << close_path;
     }
 
-private:
+    // How the reference is evaluated: "reference", "derivative", or the tier types and their precisions.
+    template<class... Tiers>
+    static std::string tiers_mode()
+    {
+        std::string mode = "tiers";
+        ((mode += std::string(" ") + typeid(Tiers).name() + ' ' + std::to_string(std::numeric_limits<Tiers>::digits)), ...);
+        return mode;
+    }
+
+    std::string reference_cache_key(std::string const & function_id, std::string const & mode, abscissa_sampling sampling,
+                                    bool perturb_abscissas, size_t samples, int random_seed) const
+    {
+        std::ostringstream key;
+        key << function_id << '\n'
+            << mode << '\n'
+            << std::hexfloat << a_ << ' ' << b_ << '\n'
+            << samples << ' ' << random_seed << ' ' << perturb_abscissas << ' ' << static_cast<int>(sampling) << '\n'
+            << typeid(PreciseReal).name() << ' ' << std::numeric_limits<PreciseReal>::digits << '\n'
+            << typeid(CoarseReal).name();
+        return key.str();
+    }
+
+    F hi_acc_impl_;
+    std::function<PreciseReal(PreciseReal)> hi_acc_derivative_;
     std::vector<PreciseReal> precise_abscissas_;
     std::vector<CoarseReal> coarse_abscissas_;
     std::vector<PreciseReal> precise_ordinates_;
     std::vector<PreciseReal> cond_;
-    std::list<std::vector<CoarseReal>> ulp_list_;
+    std::vector<CoarseReal> pixel_envelope_abscissas_;
+    std::vector<PreciseReal> pixel_envelope_cond_;
+    int pixel_envelope_width_;
+    // ULP errors of every function, stored function after function: ulps_[i*samples + j].
+    std::vector<CoarseReal> ulps_;
+    std::vector<ulp_stats<CoarseReal>> stats_;
+    std::vector<ulp_worst_case<CoarseReal>> worst_cases_;
+    std::vector<size_t> tier_escalations_;
     std::vector<std::string> colors_;
     CoarseReal a_;
     CoarseReal b_;
+    unsigned threads_;
+    bool perturb_abscissas_;
+    std::string cache_key_;
+    std::string cache_file_;
     int clip_;
     int width_;
+    int coordinate_decimals_;
+    double path_quantum_;
+    bool gzip_;
     std::string envelope_color_;
+    bool aggregate_columns_;
+    size_t refine_top_k_;
+    size_t refine_budget_;
+    envelope_resolution envelope_resolution_;
 };
 
 } // namespace quicksvg
@@ -0,0 +1,127 @@
+#ifndef QUICKSVG_ULP_STATS_HPP
+#define QUICKSVG_ULP_STATS_HPP
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace quicksvg {
+
+template<class Real>
+struct ulp_worst_case
+{
+    Real abscissa;
+    Real ulp;
+};
+
+// Summary of the ULP errors of one function, accumulated while the errors are computed,
+// so that accuracy can be checked (e.g., in CI) without rendering anything.
+template<class Real>
+struct ulp_stats
+{
+    // histogram[0] counts |ulp| <= 1/2, histogram[k] counts 2^(k-2) < |ulp| <= 2^(k-1), and the last bucket everything above.
+    static constexpr size_t buckets = 16;
+
+    Real min = std::numeric_limits<Real>::max();
+    Real max = std::numeric_limits<Real>::lowest();
+    // The signed error of largest magnitude, and where it occurred.
+    Real worst = 0;
+    Real worst_abscissa = 0;
+    long double sum = 0;
+    long double sum_abs = 0;
+    size_t count = 0;
+    size_t nan_count = 0;
+    std::array<size_t, buckets> histogram{};
+
+    static double bucket_upper_bound(size_t k)
+    {
+        return k + 1 < buckets ? std::ldexp(0.5, static_cast<int>(k)) : std::numeric_limits<double>::infinity();
+    }
+
+    double mean() const
+    {
+        return count > 0 ? static_cast<double>(sum/count) : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    double mean_abs() const
+    {
+        return count > 0 ? static_cast<double>(sum_abs/count) : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    void add(Real abscissa, Real ulp)
+    {
+        using std::abs;
+        using std::frexp;
+        using std::isfinite;
+        using std::isnan;
+        if (isnan(ulp))
+        {
+            ++nan_count;
+            return;
+        }
+        Real a = abs(ulp);
+        if (ulp < min)
+        {
+            min = ulp;
+        }
+        if (ulp > max)
+        {
+            max = ulp;
+        }
+        if (a > abs(worst))
+        {
+            worst = ulp;
+            worst_abscissa = abscissa;
+        }
+        sum += ulp;
+        sum_abs += a;
+        ++count;
+
+        size_t k = buckets - 1;
+        if (a <= 0.5)
+        {
+            k = 0;
+        }
+        else if (isfinite(a))
+        {
+            int e;
+            Real m = frexp(a, &e);
+            long b = (m == 0.5) ? e : e + 1;
+            if (b < static_cast<long>(buckets - 1))
+            {
+                k = static_cast<size_t>(b);
+            }
+        }
+        ++histogram[k];
+    }
+
+    // Ties on the worst error keep *this, so merging in abscissa order keeps the first occurrence.
+    void merge(ulp_stats const & other)
+    {
+        using std::abs;
+        if (other.min < min)
+        {
+            min = other.min;
+        }
+        if (other.max > max)
+        {
+            max = other.max;
+        }
+        if (abs(other.worst) > abs(worst))
+        {
+            worst = other.worst;
+            worst_abscissa = other.worst_abscissa;
+        }
+        sum += other.sum;
+        sum_abs += other.sum_abs;
+        count += other.count;
+        nan_count += other.nan_count;
+        for (size_t k = 0; k < buckets; ++k)
+        {
+            histogram[k] += other.histogram[k];
+        }
+    }
+};
+
+} // namespace quicksvg
+#endif
@@ -30,6 +30,7 @@ int main() {
     title = "\u2081F\u2081(3, 7, 𝑥)";
     filename = "examples/1F1_1.svg";
     quicksvg::graph_fn onef1_1graph(a, b, title, filename);
+    onef1_1graph.set_threads(0);
     onef1_1graph.add_fn(onef1_1);
     onef1_1graph.write_all();
 
@@ -39,6 +40,7 @@ int main() {
     title = "\u2081F\u2081(-2, 3, 𝑥)";
     filename = "examples/1F1_2.svg";
     quicksvg::graph_fn onef1_2graph(a, b, title, filename);
+    onef1_2graph.set_threads(0);
     onef1_2graph.add_fn(onef1_2);
     onef1_2graph.write_all();
 
@@ -49,6 +51,7 @@ int main() {
     filename = "examples/1F1_3.svg";
 
     quicksvg::graph_fn onef1_3graph(a, b, title, filename);
+    onef1_3graph.set_threads(0);
     onef1_3graph.add_fn(onef1_3);
     onef1_3graph.write_all();
 
@@ -58,6 +61,7 @@ int main() {
     title = "\u2081F\u2081(-2, -2.5, 𝑥)";
     filename = "examples/1F1_4.svg";
     quicksvg::graph_fn onef1_4graph(a, b, title, filename);
+    onef1_4graph.set_threads(0);
     onef1_4graph.add_fn(onef1_4);
     onef1_4graph.write_all();
 
@@ -1,16 +1,32 @@
 #include <boost/math/constants/constants.hpp>
+#include <boost/math/special_functions/digamma.hpp>
 #include <boost/math/special_functions/gamma.hpp>
+#include <boost/math/special_functions/lambert_w.hpp>
 #include <boost/multiprecision/cpp_bin_float.hpp>
 #include "quicksvg/graph_fn.hpp"
 #include "quicksvg/plot_time_series.hpp"
+#include "quicksvg/live_time_series.hpp"
 #include "quicksvg/ulp_plot.hpp"
+#include "quicksvg/exhaustive_ulp_plot.hpp"
 #include "quicksvg/scatter_plot.hpp"
 #include "gtest/gtest.h"
+#include <filesystem>
+#ifdef QUICKSVG_HAS_ZLIB
+#include <zlib.h>
+#endif
 
 using boost::math::constants::pi;
 using boost::multiprecision::cpp_bin_float_50;
 using boost::math::tgamma;
 
+std::string read_file(std::string const & filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    return oss.str();
+}
+
 TEST(graph_fn, types) {
     {
         float a = -pi<float>();
@@ -70,6 +86,364 @@ TEST(graph_fn, types) {
     }
 }
 
+TEST(graph_fn, batch)
+{
+    std::string scalar = "examples/sine_scalar.svg";
+    std::string batch = "examples/sine_batch.svg";
+    {
+        quicksvg::graph_fn<double> graph(-5, 5, "sin(𝑥)", scalar, 3000);
+        graph.add_fn([](double x) { return std::sin(x); });
+    }
+    {
+        size_t calls = 0;
+        quicksvg::graph_fn<double> graph(-5, 5, "sin(𝑥)", batch, 3000);
+        graph.add_fn([&calls](double const * x, double* y, size_t n)
+        {
+            ++calls;
+            for (size_t i = 0; i < n; ++i)
+            {
+                y[i] = std::sin(x[i]);
+            }
+        });
+        EXPECT_EQ(calls, 3u);
+    }
+    EXPECT_EQ(read_file(scalar), read_file(batch));
+}
+
+TEST(graph_fn, threads)
+{
+    auto f = [](double x) { return std::sin(x)/x + std::cos(3*x); };
+    std::string serial = "examples/graph_serial.svg";
+    std::string parallel = "examples/graph_parallel.svg";
+    {
+        quicksvg::graph_fn<double> graph(1, 20, "", serial, 1000);
+        graph.add_fn(f);
+    }
+    {
+        quicksvg::graph_fn<double> graph(1, 20, "", parallel, 1000);
+        graph.set_threads(3);
+        graph.add_fn(f);
+    }
+    EXPECT_EQ(read_file(serial), read_file(parallel));
+
+    // The NaN reported is the first one, whichever thread found it:
+    auto g = [](double x) { return x > 15 || (x > 7.5 && x < 8.5) ? std::numeric_limits<double>::quiet_NaN() : x; };
+    for (unsigned threads : {1u, 3u})
+    {
+        quicksvg::graph_fn<double> graph(0, 20, "", "examples/graph_nan.svg", 21);
+        graph.set_threads(threads);
+        try
+        {
+            graph.add_fn(g);
+            ADD_FAILURE() << "Expected a NaN to be reported.";
+        }
+        catch (std::domain_error const & e)
+        {
+            EXPECT_NE(std::string(e.what()).find("x = 8 "), std::string::npos) << e.what();
+        }
+        graph.add_fn([](double x) { return x; });
+    }
+}
+
+TEST(graph_fn, adaptive)
+{
+    // Points of the first path in an svg:
+    auto path_points = [](std::string const & filename)
+    {
+        std::string svg = read_file(filename);
+        std::istringstream path(svg.substr(svg.find("<path d='M") + 10));
+        std::vector<std::pair<double, double>> points;
+        char c = 'M';
+        double x, y;
+        while (c != '\'' && path >> x >> y)
+        {
+            points.emplace_back(x, y);
+            path >> c;
+        }
+        return points;
+    };
+
+    // A smooth function is resolved long before the budget runs out:
+    size_t calls = 0;
+    {
+        quicksvg::graph_fn<double> graph(0, 1, "", "examples/adaptive_sine.svg", 32);
+        graph.set_adaptive(5000);
+        graph.add_fn([&calls](double x) { ++calls; return std::sin(6*x); });
+    }
+    EXPECT_GT(calls, 32u);
+    EXPECT_LT(calls, 1000u);
+    EXPECT_EQ(path_points("examples/adaptive_sine.svg").size(), calls);
+
+    // A jump is bracketed to a fraction of a pixel, with a few hundred evaluations instead of thousands:
+    calls = 0;
+    {
+        quicksvg::graph_fn<double> graph(0, 1, "", "examples/adaptive_step.svg", 32);
+        graph.set_adaptive(300);
+        graph.add_fn([&calls](double x) { ++calls; return x < 0.314159 ? 0.0 : 1.0; });
+    }
+    EXPECT_LE(calls, 300u);
+    auto points = path_points("examples/adaptive_step.svg");
+    ASSERT_EQ(points.size(), calls);
+    for (size_t i = 1; i < points.size(); ++i)
+    {
+        EXPECT_LE(points[i - 1].first, points[i].first);
+        if (points[i].second != points[i - 1].second)
+        {
+            EXPECT_LT(points[i].first - points[i - 1].first, 0.2);
+        }
+    }
+}
+
+TEST(graph_fn, decimation)
+{
+    auto count_points = [](std::string const & filename)
+    {
+        std::string svg = read_file(filename);
+        std::string d = svg.substr(svg.find("<path d='M"));
+        d = d.substr(0, d.find("' "));
+        return 1 + std::count(d.begin(), d.end(), 'L');
+    };
+    auto f = [](double x) { return std::sin(x*x)*x; };
+    {
+        quicksvg::graph_fn<double> graph(0, 40, "", "examples/graph_decimated.svg", 200000);
+        graph.add_fn(f);
+    }
+    {
+        quicksvg::graph_fn<double> graph(0, 40, "", "examples/graph_simplified.svg", 200000);
+        graph.set_decimation(10000, 0.5);
+        graph.add_fn(f);
+    }
+    // Width 1100 leaves 1065 pixel columns, each reduced to at most four points:
+    long decimated = count_points("examples/graph_decimated.svg");
+    EXPECT_LE(decimated, 4*1066);
+    EXPECT_GT(decimated, 1065);
+    long simplified = count_points("examples/graph_simplified.svg");
+    EXPECT_LT(simplified, decimated);
+
+    // The extremes of each column survive:
+    std::vector<double> x{0.1, 0.2, 0.3, 0.4, 0.5, 1.5, 1.6, 2.5};
+    std::vector<double> y{5, 1, 9, 3, 4, 2, 2, 7};
+    std::vector<size_t> expected{0, 1, 2, 4, 5, 6, 7};
+    EXPECT_EQ(quicksvg::detail::m4_decimate(x, y), expected);
+    // Collinear points go, corners stay:
+    std::vector<double> px{0, 1, 2, 3, 4, 5, 6};
+    std::vector<double> py{0, 1, 2, 3, 2.05, 1, 0};
+    std::vector<size_t> all{0, 1, 2, 3, 4, 5, 6};
+    std::vector<size_t> corners{0, 3, 6};
+    EXPECT_EQ(quicksvg::detail::douglas_peucker(px, py, all, 0.1), corners);
+}
+
+TEST(graph_fn, coordinate_decimals)
+{
+    auto format = [](double x, int decimals)
+    {
+        std::ostringstream oss;
+        oss << quicksvg::detail::coordinate_decimals{decimals} << quicksvg::detail::coordinate(x);
+        return oss.str();
+    };
+    EXPECT_EQ(format(523.456789, 2), "523.46");
+    EXPECT_EQ(format(523.456789, 0), "523");
+    EXPECT_EQ(format(12.5, 3), "12.5");
+    EXPECT_EQ(format(-0.004, 2), "0");
+    EXPECT_EQ(format(-0.25, 1), "-0.3");
+    EXPECT_EQ(format(0.05, 4), "0.05");
+    EXPECT_EQ(format(1065, 2), "1065");
+    // Far off screen, and never nan or inf, which SVG cannot parse:
+    EXPECT_EQ(format(-1e300, 2), "-1.0000000000000001e+300");
+    EXPECT_EQ(format(std::numeric_limits<double>::infinity(), 2), "1.7976931348623157e+308");
+    EXPECT_EQ(format(std::numeric_limits<double>::quiet_NaN(), 2), "0");
+
+    boost::multiprecision::cpp_bin_float_50 x = 1;
+    x /= 3;
+    std::ostringstream oss;
+    oss << quicksvg::detail::coordinate(x);
+    EXPECT_EQ(oss.str(), "0.33");
+
+    {
+        quicksvg::graph_fn<double> graph(0, 3, "", "examples/graph_integer_coordinates.svg");
+        graph.set_coordinate_decimals(0);
+        graph.add_fn([](double t) { return std::exp(t); });
+    }
+    std::string svg = read_file("examples/graph_integer_coordinates.svg");
+    std::string d = svg.substr(svg.find("<path d='M"));
+    d = d.substr(0, d.find("' "));
+    EXPECT_EQ(d.find('.'), std::string::npos);
+    EXPECT_THROW(quicksvg::detail::checked_coordinate_decimals(10), std::domain_error);
+}
+
+TEST(graph_fn, atomic_write)
+{
+    std::string filename = "examples/graph_atomic.svg";
+    std::remove(filename.c_str());
+    {
+        quicksvg::graph_fn<double> graph(0, 1, "", filename);
+        EXPECT_THROW(graph.add_fn([](double) { return std::numeric_limits<double>::quiet_NaN(); }), std::domain_error);
+        // Nothing reaches the disk before write_all:
+        EXPECT_FALSE(std::ifstream(filename).good());
+        graph.add_fn([](double x) { return x; });
+        graph.write_all();
+    }
+    std::string svg = read_file(filename);
+    ASSERT_GE(svg.size(), 7u);
+    EXPECT_EQ(svg.substr(svg.size() - 7), "</svg>\n");
+    EXPECT_FALSE(std::ifstream(filename + ".tmp").good());
+
+    // A graph that cannot be written warns from its destructor rather than terminating the program:
+    {
+        quicksvg::graph_fn<double> empty(0, 1, "", "examples/graph_empty.svg");
+    }
+    EXPECT_FALSE(std::ifstream("examples/graph_empty.svg").good());
+
+    // The document grows past its reservation like any stream:
+    quicksvg::detail::svg_document doc;
+    std::ostringstream expected;
+    doc.reserve(16);
+    for (int i = 0; i < 100000; ++i)
+    {
+        doc << i << " " << quicksvg::detail::coordinate(i/7.0) << "\n";
+        expected << i << " " << quicksvg::detail::coordinate(i/7.0) << "\n";
+    }
+    EXPECT_EQ(doc.str(), expected.str());
+}
+
+TEST(graph_fn, compact_paths)
+{
+    auto path_data = [](std::string const & filename)
+    {
+        std::string svg = read_file(filename);
+        std::string d = svg.substr(svg.find("<path d='M") + 9);
+        return d.substr(0, d.find("' "));
+    };
+    // Absolute M/L, or relative l/h/v with implicit repetition, to a list of points:
+    auto decode = [](std::string const & d)
+    {
+        std::vector<std::pair<double, double>> points;
+        char command = 0;
+        double x = 0;
+        double y = 0;
+        size_t pos = 0;
+        auto number = [&]()
+        {
+            while (d[pos] == ' ')
+            {
+                ++pos;
+            }
+            // A number ends at a space, a command, a minus sign, or a second decimal point:
+            size_t end = pos + 1;
+            bool dot = d[pos] == '.';
+            while (end < d.size() && (std::isdigit(d[end]) || (d[end] == '.' && !dot)))
+            {
+                dot = dot || d[end] == '.';
+                ++end;
+            }
+            double value = std::stod(d.substr(pos, end - pos));
+            pos = end;
+            return value;
+        };
+        while (pos < d.size())
+        {
+            if (d[pos] == ' ')
+            {
+                ++pos;
+                continue;
+            }
+            if (std::isalpha(d[pos]))
+            {
+                command = d[pos++];
+                continue;
+            }
+            switch (command)
+            {
+                case 'M': case 'L': x = number(); y = number(); break;
+                case 'l': x += number(); y += number(); break;
+                case 'h': x += number(); break;
+                case 'v': y += number(); break;
+            }
+            points.emplace_back(x, y);
+        }
+        return points;
+    };
+
+    auto f = [](double t) { return std::sin(t)*std::exp(-t/8); };
+    {
+        quicksvg::graph_fn<double> graph(0, 20, "", "examples/graph_absolute.svg", 1000);
+        graph.add_fn(f);
+    }
+    {
+        quicksvg::graph_fn<double> graph(0, 20, "", "examples/graph_compact.svg", 1000);
+        graph.set_compact_paths(true, 0.1);
+        graph.add_fn(f);
+    }
+    std::string absolute = path_data("examples/graph_absolute.svg");
+    std::string compact = path_data("examples/graph_compact.svg");
+    EXPECT_LT(2*compact.size(), absolute.size());
+
+    auto exact = decode(absolute);
+    auto snapped = decode(compact);
+    ASSERT_EQ(exact.size(), 1000u);
+    ASSERT_GT(snapped.size(), 100u);
+    // Every point written is within half a quantum (plus the 0.01px of the absolute coordinates) of a sample, in order:
+    size_t j = 0;
+    for (auto const & p : snapped)
+    {
+        while (j < exact.size() && (std::abs(exact[j].first - p.first) > 0.06 || std::abs(exact[j].second - p.second) > 0.06))
+        {
+            ++j;
+        }
+        ASSERT_LT(j, exact.size()) << "No sample near (" << p.first << ", " << p.second << ")";
+    }
+}
+
+#ifdef QUICKSVG_HAS_ZLIB
+TEST(graph_fn, gzip)
+{
+    auto gunzip = [](std::string const & filename)
+    {
+        std::string text;
+        gzFile gz = gzopen(filename.c_str(), "rb");
+        char buffer[4096];
+        int n;
+        while ((n = gzread(gz, buffer, sizeof(buffer))) > 0)
+        {
+            text.append(buffer, n);
+        }
+        gzclose(gz);
+        return text;
+    };
+    auto f = [](double t) { return std::sin(t*t); };
+    // Large enough to be deflated in several chunks:
+    for (std::string filename : {"examples/graph_gzip.svg", "examples/graph_gzip.svgz"})
+    {
+        quicksvg::graph_fn<double> graph(0, 30, "", filename, 9000);
+        graph.add_fn(f);
+    }
+    std::string plain = read_file("examples/graph_gzip.svg");
+    EXPECT_GT(plain.size(), 2*quicksvg::detail::gzip_chunk_size);
+    EXPECT_EQ(gunzip("examples/graph_gzip.svgz"), plain);
+    EXPECT_LT(2*read_file("examples/graph_gzip.svgz").size(), plain.size());
+
+    auto hi = [](boost::multiprecision::cpp_bin_float_50 x) { return exp(x); };
+    quicksvg::ulp_plot<decltype(hi), boost::multiprecision::cpp_bin_float_50, double> plot(hi, 0.0, 1.0, true, 2000);
+    plot.add_fn([](double x) { return std::exp(x); });
+    plot.write("examples/ulp_exp_gzip.svg");
+    plot.write("examples/ulp_exp_gzip.svg.gz");
+    EXPECT_EQ(gunzip("examples/ulp_exp_gzip.svg.gz"), read_file("examples/ulp_exp_gzip.svg"));
+
+    // Only SVG names select compression:
+    EXPECT_TRUE(quicksvg::detail::is_gzip_filename("plot.svgz"));
+    EXPECT_TRUE(quicksvg::detail::is_gzip_filename("plot.svg.gz"));
+    EXPECT_FALSE(quicksvg::detail::is_gzip_filename("plot.gz"));
+    EXPECT_FALSE(quicksvg::detail::is_gzip_filename("plot.tar.gz"));
+    EXPECT_FALSE(quicksvg::detail::is_gzip_filename("plot.svg"));
+}
+#else
+TEST(graph_fn, gzip_without_zlib)
+{
+    // Caught when the graph is made, not in its destructor:
+    EXPECT_THROW(quicksvg::graph_fn<double>(0, 1, "", "examples/graph_gzip.svgz"), std::logic_error);
+}
+#endif
+
 TEST(PlotTimeSeries, types)
 {
     {
@@ -150,15 +524,381 @@ TEST(PlotTimeSeries, types)
     }
 }
 
+TEST(PlotTimeSeries, dataset_ownership)
+{
+    std::vector<double> v(5000);
+    std::vector<std::pair<double, double>> p(v.size());
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        v[i] = std::sin(i/100.0);
+        p[i] = {std::cos(i/300.0), v[i]};
+    }
+    auto copied = v;
+    auto moved = v;
+    auto shared = std::make_shared<std::vector<double> const>(v);
+    auto copied_pairs = p;
+    auto moved_pairs = p;
+
+    std::vector<std::string> series;
+    std::vector<std::string> scatter;
+    for (int way = 0; way < 4; ++way)
+    {
+        std::string name = "examples/dataset_" + std::to_string(way);
+        quicksvg::plot_time_series<double> pts(0, 0.5, "", name + "_series.svg");
+        quicksvg::scatter_plot<double> sp("", name + "_scatter.svg");
+        switch (way)
+        {
+            case 0: pts.add_dataset(copied); sp.add_dataset(copied_pairs, true); break;
+            case 1: pts.add_dataset(std::move(moved)); sp.add_dataset(std::move(moved_pairs), true); break;
+            case 2: pts.add_dataset(shared); sp.add_dataset(std::make_shared<std::vector<std::pair<double, double>> const>(p), true); break;
+            case 3: pts.add_dataset(v.data(), v.size()); sp.add_dataset(p.data(), p.size(), true); break;
+        }
+        pts.write_all();
+        sp.write_all();
+        series.push_back(read_file(name + "_series.svg"));
+        scatter.push_back(read_file(name + "_scatter.svg"));
+    }
+    for (int way = 1; way < 4; ++way)
+    {
+        EXPECT_EQ(series[way], series[0]);
+        EXPECT_EQ(scatter[way], scatter[0]);
+    }
+    // Moved, not copied:
+    EXPECT_TRUE(moved.empty());
+    EXPECT_TRUE(moved_pairs.empty());
+}
+
+TEST(PlotTimeSeries, streaming)
+{
+    // With the axes fixed at the data range, streaming writes the same file as buffering:
+    std::vector<double> v(5000);
+    std::vector<std::pair<double, double>> p(3000);
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        v[i] = std::sin(i/100.0);
+    }
+    for (size_t i = 0; i < p.size(); ++i)
+    {
+        p[i] = {std::cos(i/300.0), v[i]};
+    }
+    auto y_range = std::minmax_element(v.begin(), v.end());
+    quicksvg::fixed_axes<double> series_axes{0, 0.5*(v.size() - 1), *y_range.first, *y_range.second};
+
+    quicksvg::plot_time_series<double> buffered(0, 0.5, "", "examples/streaming_buffered_series.svg");
+    buffered.add_dataset(v);
+    buffered.write_all();
+    quicksvg::plot_time_series<double> streamed(series_axes, 0.5, "", "examples/streaming_series.svg");
+    EXPECT_THROW(streamed.append(1.0), std::logic_error);
+    streamed.begin_series();
+    for (size_t i = 0; i < v.size(); i += 1000)
+    {
+        streamed.append(v.data() + i, 1000);
+    }
+    streamed.write_all();
+    EXPECT_EQ(read_file("examples/streaming_series.svg"), read_file("examples/streaming_buffered_series.svg"));
+
+    quicksvg::fixed_axes<double> scatter_axes{1, -1, 1, -1};
+    for (auto const & q : p)
+    {
+        scatter_axes = {std::min(scatter_axes.x_min, q.first), std::max(scatter_axes.x_max, q.first),
+                        std::min(scatter_axes.y_min, q.second), std::max(scatter_axes.y_max, q.second)};
+    }
+    quicksvg::scatter_plot<double> buffered_scatter("", "examples/streaming_buffered_scatter.svg");
+    buffered_scatter.add_dataset(p, true);
+    buffered_scatter.write_all();
+    quicksvg::scatter_plot<double> streamed_scatter(scatter_axes, "", "examples/streaming_scatter.svg");
+    streamed_scatter.add_dataset(p.data(), p.size(), true);
+    streamed_scatter.write_all();
+    EXPECT_EQ(read_file("examples/streaming_scatter.svg"), read_file("examples/streaming_buffered_scatter.svg"));
+
+    // Past the decimation threshold a streamed scatter plot is bounded by the picture, not the point count:
+    std::vector<size_t> scatter_sizes;
+    for (size_t n : {100000, 1000000})
+    {
+        std::vector<std::pair<double, double>> q(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            double x = double(i)/n;
+            q[i] = {x, std::sin(20*x) + 0.05*std::sin(0.7*i)};
+        }
+        std::string name = "examples/streaming_scatter_" + std::to_string(n) + ".svg";
+        quicksvg::scatter_plot<double> bounded(quicksvg::fixed_axes<double>{0, 1, -1.1, 1.1}, "", name);
+        bounded.add_dataset(q.data(), q.size(), true);
+        bounded.write_all();
+        scatter_sizes.push_back(read_file(name).size());
+    }
+    EXPECT_LT(scatter_sizes[1], 2*scatter_sizes[0]);
+    EXPECT_LT(scatter_sizes[1], 3000000u);
+
+    // Decimated as it streams, so the file stays small however long the series; a smooth curve lands on few pixels,
+    // so it has few dots too:
+    quicksvg::plot_time_series<double> endless(quicksvg::fixed_axes<double>{0, 1, -1, 1}, 1e-6, "", "examples/streaming_endless.svg");
+    endless.begin_series();
+    for (size_t i = 0; i < 1000000; ++i)
+    {
+        endless.append(std::sin(i/100000.0));
+    }
+    endless.write_all();
+    EXPECT_LT(read_file("examples/streaming_endless.svg").size(), 300000u);
+
+    auto f = [](double x) { return std::max(-0.9, std::min(0.9, std::sin(50*x))); };
+    double two_pi = 2*boost::math::constants::pi<double>();
+    {
+        quicksvg::graph_fn<double> buffered_fn(0, two_pi, "", "examples/streaming_buffered_fn.svg", 200000);
+        buffered_fn.set_decimation(10000, 0.5);
+        buffered_fn.add_fn(f);
+        quicksvg::graph_fn<double> streamed_fn(quicksvg::fixed_axes<double>{0, two_pi, -0.9, 0.9}, "", "examples/streaming_fn.svg", 200000);
+        streamed_fn.set_decimation(10000, 0.5);
+        streamed_fn.set_threads(4);
+        streamed_fn.add_fn(f);
+        streamed_fn.set_adaptive(400000);
+        EXPECT_THROW(streamed_fn.add_fn(f), std::logic_error);
+    }
+    EXPECT_EQ(read_file("examples/streaming_fn.svg"), read_file("examples/streaming_buffered_fn.svg"));
+
+    quicksvg::plot_time_series<double> unfixed(0, 1, "", "examples/streaming_unfixed.svg");
+    EXPECT_THROW(unfixed.begin_series(), std::logic_error);
+    unfixed.add_dataset(v);
+    unfixed.write_all();
+    EXPECT_THROW(quicksvg::fixed_axes<double>({0, 1, 1, 1}).check(), std::domain_error);
+}
+
+TEST(PlotTimeSeries, binary_file)
+{
+    // A 16 byte header, three interleaved float64 series, then two planar float32 series:
+    size_t n = 20000;
+    std::vector<std::vector<double>> series(5, std::vector<double>(n));
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < series.size(); ++j)
+        {
+            series[j][i] = std::sin((j + 1)*i/700.0) + j;
+        }
+    }
+    std::vector<float> planar(2*n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        planar[i] = static_cast<float>(series[3][i]);
+        planar[n + i] = static_cast<float>(series[4][i]);
+        series[3][i] = planar[i];
+        series[4][i] = planar[n + i];
+    }
+    std::string bin = "examples/binary_series.bin";
+    {
+        std::ofstream ofs(bin, std::ios::binary);
+        ofs.write("quicksvg-samples", 16);
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (size_t j = 0; j < 3; ++j)
+            {
+                ofs.write(reinterpret_cast<char const *>(&series[j][i]), sizeof(double));
+            }
+        }
+        ofs.write(reinterpret_cast<char const *>(planar.data()), planar.size()*sizeof(float));
+    }
+
+    quicksvg::plot_time_series<double> from_memory(0, 0.01, "", "examples/binary_series_memory.svg");
+    quicksvg::plot_time_series<double> from_file(0, 0.01, "", "examples/binary_series_file.svg");
+    from_file.set_threads(4);
+    for (size_t j = 0; j < series.size(); ++j)
+    {
+        from_memory.add_dataset(series[j], j % 2 == 0);
+    }
+    using quicksvg::binary_series;
+    using quicksvg::sample_type;
+    for (size_t j = 0; j < 3; ++j)
+    {
+        from_file.add_binary_file(bin, binary_series::interleaved(sample_type::float64, 3, j, n, 16), j % 2 == 0);
+    }
+    size_t planar_start = 16 + 3*n*sizeof(double);
+    from_file.add_binary_file(bin, binary_series::planar(sample_type::float32, 0, n, planar_start), false);
+    from_file.add_binary_file(bin, binary_series{sample_type::float32, planar_start + n*sizeof(float), 0, n}, true);
+    EXPECT_THROW(from_file.add_binary_file(bin, binary_series::planar(sample_type::float32, 2, n, planar_start)), std::domain_error);
+    EXPECT_THROW(from_file.add_binary_file("examples/no_such_file.bin", binary_series::planar(sample_type::float64, 0, n)), std::runtime_error);
+    from_memory.write_all();
+    from_file.write_all();
+    std::string svg = read_file("examples/binary_series_file.svg");
+    EXPECT_EQ(svg, read_file("examples/binary_series_memory.svg"));
+    // Decimated, dots included:
+    EXPECT_LT(svg.size(), 2000000u);
+}
+
+TEST(PlotTimeSeries, write_range)
+{
+    std::vector<double> v(200000);
+    std::vector<double> w(50000);
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        v[i] = std::sin(i/3000.0) + 0.3*std::sin(i/7.0);
+    }
+    for (size_t i = 0; i < w.size(); ++i)
+    {
+        w[i] = std::cos(i/500.0);
+    }
+    quicksvg::plot_time_series<double> pts(0, 0.5, "Zoom", "examples/write_range_full.svg");
+    pts.add_dataset(v);
+    pts.add_dataset(w, false, "crimson", "gray");
+    pts.set_threads(3);
+
+    // The svg without its dots, which a window draws only at the kept points:
+    auto without_dots = [](std::string const & svg)
+    {
+        std::istringstream lines(svg);
+        std::string line;
+        std::string kept;
+        while (std::getline(lines, line))
+        {
+            if (line.rfind("<circle", 0) != 0)
+            {
+                kept += line + "\n";
+            }
+        }
+        return kept;
+    };
+    auto dots = [](std::string const & svg)
+    {
+        size_t count = 0;
+        for (size_t k = svg.find("<circle"); k != std::string::npos; k = svg.find("<circle", k + 1))
+        {
+            ++count;
+        }
+        return count;
+    };
+    // A window on samples [begin, end) must look like a plot of just those samples on the same axes, dots aside:
+    auto expected = [&](size_t begin, size_t end, std::string const & filename)
+    {
+        size_t w_end = std::min(end, w.size());
+        auto range = std::minmax_element(v.begin() + begin, v.begin() + end);
+        double lo = *range.first;
+        double hi = *range.second;
+        if (begin < w_end)
+        {
+            auto w_range = std::minmax_element(w.begin() + begin, w.begin() + w_end);
+            lo = std::min(lo, *w_range.first);
+            hi = std::max(hi, *w_range.second);
+        }
+        quicksvg::plot_time_series<double> window(quicksvg::fixed_axes<double>{0.5*begin, 0.5*(end - 1), lo, hi}, 0.5, "Zoom", filename);
+        window.add_dataset(v.data() + begin, end - begin);
+        if (begin < w_end)
+        {
+            window.add_dataset(w.data() + begin, w_end - begin, false, "crimson", "gray");
+        }
+        window.write_all();
+        return without_dots(read_file(filename));
+    };
+    for (auto r : {std::pair<size_t, size_t>{30000, 150000}, {1000, 3000}, {40000, 200000}})
+    {
+        pts.write_range(0.5*r.first, 0.5*(r.second - 1), "examples/write_range_window.svg");
+        EXPECT_EQ(without_dots(read_file("examples/write_range_window.svg")), expected(r.first, r.second, "examples/write_range_expected.svg"));
+    }
+    // Its dots are only at the kept points, at most four per pixel column for each dataset:
+    pts.write_range(0, 99999.5, "examples/write_range_window.svg");
+    EXPECT_LE(dots(read_file("examples/write_range_window.svg")), 2*4*1066u);
+    // The whole plot draws a dot on every pixel a sample lands on: fewer than one per sample, more than M4 keeps.
+    pts.write_all();
+    size_t full_dots = dots(read_file("examples/write_range_full.svg"));
+    EXPECT_GT(full_dots, 2*4*1066u);
+    EXPECT_LT(full_dots, v.size());
+
+    // A saved index serves another plot of the same data:
+    pts.save_range_index(0, "examples/write_range.qsi");
+    EXPECT_FALSE(std::ifstream("examples/write_range.qsi.tmp").good());
+    quicksvg::plot_time_series<double> reloaded(0, 0.5, "Zoom", "examples/write_range_reloaded.svg");
+    reloaded.add_dataset(v.data(), v.size());
+    reloaded.add_dataset(w.data(), w.size(), false, "crimson", "gray");
+    reloaded.load_range_index(0, "examples/write_range.qsi");
+    EXPECT_THROW(reloaded.load_range_index(1, "examples/write_range.qsi"), std::domain_error);
+    // A damaged index is rejected rather than trusted: the level count, a level's size, and a sample index.
+    for (size_t offset : {24, 32, 40})
+    {
+        std::string index = read_file("examples/write_range.qsi");
+        uint64_t bad = 1000000000;
+        std::memcpy(&index[offset], &bad, sizeof(bad));
+        std::ofstream("examples/write_range_tampered.qsi", std::ios::binary) << index;
+        EXPECT_THROW(reloaded.load_range_index(0, "examples/write_range_tampered.qsi"), std::runtime_error) << offset;
+    }
+    reloaded.write_range(15000, 74999.5, "examples/write_range_window.svg");
+    EXPECT_EQ(without_dots(read_file("examples/write_range_window.svg")), expected(30000, 150000, "examples/write_range_expected.svg"));
+    EXPECT_THROW(reloaded.write_range(1, 1, "examples/write_range_window.svg"), std::domain_error);
+    EXPECT_THROW(reloaded.write_range(1e6, 2e6, "examples/write_range_window.svg"), std::domain_error);
+    reloaded.write_all();
+
+    quicksvg::plot_time_series<double> streamed(quicksvg::fixed_axes<double>{0, 1, -1, 1}, 0.1, "", "examples/write_range_streamed.svg");
+    EXPECT_THROW(streamed.write_range(0, 1, "examples/write_range_window.svg"), std::logic_error);
+    streamed.write_all();
+}
+
+TEST(PlotTimeSeries, live)
+{
+    size_t capacity = 500;
+    quicksvg::live_time_series<double> live(capacity, 0, 1, "Live");
+    EXPECT_THROW(live.snapshot("examples/live.svg"), std::logic_error);
+    EXPECT_THROW(live.append(std::numeric_limits<double>::quiet_NaN()), std::domain_error);
+    EXPECT_THROW(quicksvg::live_time_series<double>(1, 0, 1, ""), std::domain_error);
+
+    std::vector<double> history;
+    for (size_t i = 0; i < 3000; ++i)
+    {
+        // Plateaus give the deques ties to handle:
+        double y = std::round(4*std::sin(i/37.0) + 3*std::cos(i/180.0));
+        history.push_back(y);
+        live.append(y);
+        if ((i + 1) % 250 != 0)
+        {
+            continue;
+        }
+        size_t first = history.size() - live.size();
+        auto range = std::minmax_element(history.begin() + first, history.end());
+        EXPECT_EQ(live.min(), *range.first);
+        EXPECT_EQ(live.max(), *range.second);
+        live.snapshot("examples/live.svg");
+        if (history.size() < capacity)
+        {
+            continue;
+        }
+        // Once the window is full, a snapshot is the time series plot of the window:
+        quicksvg::plot_time_series<double> window(static_cast<double>(first), 1, "Live", "examples/live_window.svg");
+        window.add_dataset(history.data() + first, capacity);
+        window.write_all();
+        EXPECT_EQ(read_file("examples/live.svg"), read_file("examples/live_window.svg"));
+    }
+
+    // Likewise with other coordinate formats, and an unchanged window is written the same way twice:
+    live.set_coordinate_decimals(4);
+    live.set_compact_paths(true);
+    live.snapshot("examples/live.svg");
+    live.snapshot("examples/live_again.svg");
+    size_t first = history.size() - capacity;
+    quicksvg::plot_time_series<double> window(static_cast<double>(first), 1, "Live", "examples/live_window.svg");
+    window.set_coordinate_decimals(4);
+    window.set_compact_paths(true);
+    window.add_dataset(history.data() + first, capacity);
+    window.write_all();
+    EXPECT_EQ(read_file("examples/live.svg"), read_file("examples/live_window.svg"));
+    EXPECT_EQ(read_file("examples/live_again.svg"), read_file("examples/live.svg"));
+
+    // A flat window still has some height:
+    quicksvg::live_time_series<double> flat(10, 0, 0.5, "");
+    for (int i = 0; i < 5; ++i)
+    {
+        flat.append(2);
+    }
+    flat.snapshot("examples/live_flat.svg");
+    EXPECT_EQ(read_file("examples/live_flat.svg").find("nan"), std::string::npos);
+}
+
 TEST(ULPPlot, types)
 {
+    auto hi_acc = [](cpp_bin_float_50 x)->cpp_bin_float_50 { return tgamma(x); };
     {
         int samples = 10000;
         float a = 1;
         float b = 15;
         std::string title = "ULP accuracy of float precision gamma on [1, 15]";
         std::string filename = "examples/ulp_gamma_float.svg";
-        quicksvg::ulp_plot(tgamma<float>, tgamma<cpp_bin_float_50>, a, b, title, filename, samples);
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, float> plot(hi_acc, a, b, true, samples);
+        plot.add_fn([](float x) { return tgamma(x); });
+        plot.write(filename, true, title);
     }
     {
         int samples = 10000;
@@ -166,7 +906,9 @@ TEST(ULPPlot, types)
         double b = 15;
         std::string title = "ULP accuracy of double precision sin on [1, 15]";
         std::string filename = "examples/ulp_gamma_double.svg";
-        quicksvg::ulp_plot(tgamma<double>, tgamma<cpp_bin_float_50>, a, b, title, filename, samples);
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, double> plot(hi_acc, a, b, true, samples);
+        plot.add_fn([](double x) { return tgamma(x); });
+        plot.write(filename, true, title);
     }
     {
         int samples = 10000;
@@ -174,8 +916,402 @@ TEST(ULPPlot, types)
         long double b = 15;
         std::string title = "ULP accuracy of long double precision sin on [1, 15]";
         std::string filename = "examples/ulp_gamma_long_double.svg";
-        quicksvg::ulp_plot(tgamma<long double>, tgamma<cpp_bin_float_50>, a, b, title, filename, samples);
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, long double> plot(hi_acc, a, b, true, samples);
+        plot.add_fn([](long double x) { return tgamma(x); });
+        plot.write(filename, true, title);
+    }
+}
+
+TEST(ULPPlot, threads)
+{
+    auto hi_acc = [](cpp_bin_float_50 x)->cpp_bin_float_50 { return tgamma(x); };
+    auto lo_acc = [](double x) { return tgamma(x); };
+    std::string serial = "examples/ulp_gamma_serial.svg";
+    std::string parallel = "examples/ulp_gamma_parallel.svg";
+    {
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, double> plot(hi_acc, 1.0, 15.0, true, 2000, 7, 1);
+        plot.add_fn(lo_acc);
+        plot.write(serial);
+    }
+    {
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, double> plot(hi_acc, 1.0, 15.0, true, 2000, 7, 3);
+        plot.add_fn(lo_acc);
+        plot.write(parallel);
+    }
+    EXPECT_EQ(read_file(serial), read_file(parallel));
+}
+
+TEST(ULPPlot, reference_cache)
+{
+    int calls = 0;
+    auto hi_acc = [&calls](cpp_bin_float_50 x)->cpp_bin_float_50 { ++calls; return tgamma(x); };
+    auto lo_acc = [](double x) { return tgamma(x); };
+    // A fresh directory on every run, so the first plot below is always a miss:
+    std::string directory = "examples/reference_cache";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    quicksvg::reference_cache cache{"tgamma", directory};
+    std::string first = "examples/ulp_gamma_cache_miss.svg";
+    std::string second = "examples/ulp_gamma_cache_hit.svg";
+    {
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, double> plot(hi_acc, 1.0, 15.0, true, 500, 11, 1, cache);
+        plot.add_fn(lo_acc);
+        plot.write(first);
+    }
+    calls = 0;
+    {
+        quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, double> plot(hi_acc, 1.0, 15.0, true, 500, 11, 1, cache);
+        plot.add_fn(lo_acc);
+        plot.write(second);
+    }
+    EXPECT_EQ(calls, 0);
+    EXPECT_EQ(read_file(first), read_file(second));
+
+    // Condition numbers from an analytic derivative are not those of the plain reference, so they are cached apart:
+    calls = 0;
+    std::function<cpp_bin_float_50(cpp_bin_float_50)> derivative = [](cpp_bin_float_50 x) { return tgamma(x)*boost::math::digamma(x); };
+    quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, double> with_derivative(hi_acc, derivative, 1.0, 15.0,
+        quicksvg::abscissa_sampling::random_sorted, true, 500, 11, 1, cache);
+    EXPECT_EQ(calls, 500);
+}
+
+TEST(ULPPlot, pixel_envelope)
+{
+    size_t calls = 0;
+    auto hi_acc = [&calls](long double x) { ++calls; return boost::math::tgamma(x); };
+    auto lo_acc = [](double x) { return boost::math::tgamma(x); };
+    // Poles at -3, -2, -1 and 0 cut the envelope into five pieces above and five below the axis:
+    quicksvg::ulp_plot<decltype(hi_acc), long double, double> plot(hi_acc, -3.5, 1.5, false, 20000, 5, 1);
+    plot.add_fn(lo_acc);
+    plot.set_clip(100);
+
+    plot.set_envelope_resolution(quicksvg::envelope_resolution::per_pixel);
+    calls = 0;
+    plot.write("examples/ulp_gamma_pixel_envelope.svg");
+    size_t pixel_calls = calls;
+    std::string svg = read_file("examples/ulp_gamma_pixel_envelope.svg");
+    size_t paths = 0;
+    for (size_t pos = svg.find("stroke='chartreuse'"); pos != std::string::npos; pos = svg.find("stroke='chartreuse'", pos + 1))
+    {
+        ++paths;
+    }
+    EXPECT_GE(paths, 10u);
+    EXPECT_EQ(svg.find("nan"), std::string::npos);
+
+    plot.set_envelope_resolution(quicksvg::envelope_resolution::per_sample);
+    calls = 0;
+    plot.write("examples/ulp_gamma_sample_envelope.svg");
+    EXPECT_LT(4*pixel_calls, calls);
+}
+
+TEST(ULPPlot, derivative)
+{
+    size_t calls = 0;
+    size_t derivative_calls = 0;
+    auto hi_acc = [&calls](long double x) { ++calls; return std::exp(x); };
+    auto hi_acc_prime = [&derivative_calls](long double x) { ++derivative_calls; return std::exp(x); };
+    quicksvg::ulp_plot<decltype(hi_acc), long double, float> plot(hi_acc, hi_acc_prime, -5.0f, 5.0f,
+                                                                  quicksvg::abscissa_sampling::random_sorted, false, 1000, 2);
+    EXPECT_EQ(calls, 1000u);
+    plot.add_fn([](float x) { return std::exp(x); });
+    calls = 0;
+    plot.write("examples/ulp_exp_derivative.svg");
+    EXPECT_EQ(calls, 0u);
+    EXPECT_EQ(derivative_calls, 1000u);
+
+    // Numerical differentiation gives the same envelope at the written precision:
+    quicksvg::ulp_plot<decltype(hi_acc), long double, float> numerical(hi_acc, -5.0f, 5.0f, false, 1000, 2);
+    numerical.add_fn([](float x) { return std::exp(x); });
+    numerical.write("examples/ulp_exp_numerical_derivative.svg");
+    EXPECT_EQ(read_file("examples/ulp_exp_derivative.svg"), read_file("examples/ulp_exp_numerical_derivative.svg"));
+}
+
+TEST(ULPPlot, precision_tiers)
+{
+    // log has condition number 1/|log(x)| ~ 1/|x - 1| near 1, so only samples within ~2e-6 of it
+    // (about 2% of them) should need more than double to score float ULPs:
+    auto hi_acc = [](auto x) { using std::log; return log(x); };
+    auto lo_acc = [](float x) { return std::log(x); };
+    float a = 1.0000001f;
+    float b = 1.0001f;
+    using plot_type = quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, float>;
+    plot_type tiered(hi_acc, quicksvg::precision_tiers<double>(), a, b, quicksvg::abscissa_sampling::random_sorted, true, 2000, 4);
+    plot_type reference(hi_acc, a, b, true, 2000, 4);
+    tiered.add_fn(lo_acc);
+    reference.add_fn(lo_acc);
+
+    ASSERT_EQ(tiered.tier_escalations().size(), 1u);
+    EXPECT_GT(tiered.tier_escalations()[0], 0u);
+    EXPECT_LT(tiered.tier_escalations()[0], 100u);
+    EXPECT_TRUE(reference.tier_escalations().empty());
+    EXPECT_NEAR(tiered.stats().max, reference.stats().max, 1e-3);
+    EXPECT_NEAR(tiered.stats().min, reference.stats().min, 1e-3);
+    EXPECT_NEAR(tiered.stats().mean_abs(), reference.stats().mean_abs(), 1e-3);
+    tiered.write("examples/ulp_log_tiers.svg");
+}
+
+TEST(ULPPlot, with_coarse_type)
+{
+    size_t calls = 0;
+    auto hi_acc = [&calls](cpp_bin_float_50 x) { ++calls; return exp(x); };
+    quicksvg::ulp_plot<decltype(hi_acc), cpp_bin_float_50, float> float_plot(hi_acc, -5.0f, 5.0f, false, 1000, 8, 1);
+    float_plot.set_clip(4);
+    float_plot.add_fn([](float x) { return std::exp(x); });
+    float_plot.write("examples/ulp_exp_shared_float.svg");
+
+    calls = 0;
+    auto double_plot = float_plot.with_coarse_type<double>();
+    auto long_double_plot = float_plot.with_coarse_type<long double>();
+    EXPECT_EQ(double_plot.function_count(), 0u);
+    double_plot.add_fn([](double x) { return std::exp(x); });
+    long_double_plot.add_fn([](long double x) { return std::exp(x); });
+    double_plot.write("examples/ulp_exp_shared_double.svg");
+    long_double_plot.write("examples/ulp_exp_shared_long_double.svg");
+    // The condition numbers were computed when the float plot was written:
+    EXPECT_EQ(calls, 0u);
+    EXPECT_LE(std::abs(double_plot.stats().worst), 1.0);
+    EXPECT_LE(std::abs(long_double_plot.stats().worst), 1.0L);
+    EXPECT_EQ(double_plot.stats().count, 1000u);
+
+    // Narrowing moves unperturbed abscissas to float, and the reference goes with them, so the identity is exact:
+    auto identity = [&calls](cpp_bin_float_50 x) { ++calls; return x; };
+    quicksvg::ulp_plot<decltype(identity), cpp_bin_float_50, double> wide(identity, 1.0, 2.0, false, 1000, 8, 1);
+    calls = 0;
+    auto narrow = wide.with_coarse_type<float>();
+    EXPECT_GT(calls, 900u);
+    narrow.add_fn([](float x) { return x; });
+    EXPECT_EQ(narrow.stats().worst, 0.0f);
+    EXPECT_EQ(narrow.stats().count, 1000u);
+}
+
+TEST(ULPPlot, batch)
+{
+    auto hi_acc = [](long double x) { return std::exp(x); };
+    using plot_type = quicksvg::ulp_plot<decltype(hi_acc), long double, float>;
+    plot_type scalar(hi_acc, -5.0f, 5.0f, true, 2500, 9);
+    plot_type batch(hi_acc, -5.0f, 5.0f, true, 2500, 9);
+    scalar.add_fn([](float x) { return std::exp(x); });
+    batch.add_fn([](float const * x, float* y, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            y[i] = std::exp(x[i]);
+        }
+    });
+    scalar.write("examples/ulp_exp_scalar.svg");
+    batch.write("examples/ulp_exp_batch.svg");
+    EXPECT_EQ(read_file("examples/ulp_exp_scalar.svg"), read_file("examples/ulp_exp_batch.svg"));
+    // The refinement pass calls a batch callable one point at a time:
+    batch.set_refinement(2, 20);
+    batch.add_fn([](float const * x, float* y, size_t n) { std::transform(x, x + n, y, [](float t) { return std::exp(t); }); });
+    EXPECT_GE(std::abs(batch.worst_case(1).ulp), std::abs(batch.stats(1).worst));
+
+    // The bit-pattern kernel agrees with nextafter everywhere, including subnormals, max, inf and nan:
+    std::vector<double> y_hi{0.0, 1e-310, -4.9e-324, 1e-300, 1.0, -1.5, 2.0, 3.7e200, std::numeric_limits<double>::max(),
+                             std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()};
+    for (auto c : {std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::max(), 1.0f})
+    {
+        y_hi.push_back(c);
+        y_hi.push_back(std::nextafter(c, 0.0f));
+    }
+    std::vector<double> y_lo(y_hi.size());
+    for (size_t i = 0; i < y_hi.size(); ++i)
+    {
+        y_lo[i] = y_hi[i]*(1 + 1e-7) + 1e-40;
+    }
+    std::vector<float> ulps(y_hi.size());
+    quicksvg::detail::ulp_distances(y_hi.data(), y_lo.data(), ulps.data(), ulps.size());
+    for (size_t i = 0; i < y_hi.size(); ++i)
+    {
+        float expected = quicksvg::detail::ulp_distance<float>(y_hi[i], y_lo[i]);
+        EXPECT_TRUE(ulps[i] == expected || (std::isnan(ulps[i]) && std::isnan(expected))) << y_hi[i];
+    }
+}
+
+TEST(ULPPlot, aggregate_columns)
+{
+    auto hi_acc = [](long double x) { return std::exp(x); };
+    auto lo_acc = [](float x) { return std::exp(x); };
+    quicksvg::ulp_plot<decltype(hi_acc), long double, float> plot(hi_acc, -5.0f, 5.0f, false, 50000);
+    plot.add_fn(lo_acc);
+    std::string dots = "examples/ulp_exp_dots.svg";
+    std::string columns = "examples/ulp_exp_columns.svg";
+    plot.write(dots, false);
+    plot.set_aggregate_columns(true);
+    plot.write(columns, false);
+
+    std::string svg = read_file(columns);
+    EXPECT_EQ(svg.find("<circle"), std::string::npos);
+    EXPECT_LT(4*svg.size(), read_file(dots).size());
+}
+
+TEST(ULPPlot, sampling)
+{
+    auto hi_acc = [](long double x) { return std::exp(x); };
+    auto lo_acc = [](float x) { return std::exp(x); };
+    using plot_type = quicksvg::ulp_plot<decltype(hi_acc), long double, float>;
+    auto render = [&](quicksvg::abscissa_sampling sampling, int seed, unsigned threads)
+    {
+        plot_type plot(hi_acc, -5.0f, 5.0f, sampling, true, 20000, seed, threads);
+        plot.add_fn(lo_acc);
+        std::string filename = "examples/ulp_exp_sampling.svg";
+        plot.write(filename);
+        return read_file(filename);
+    };
+
+    using quicksvg::abscissa_sampling;
+    for (auto sampling : {abscissa_sampling::random_sorted, abscissa_sampling::order_statistics, abscissa_sampling::stratified,
+                          abscissa_sampling::low_discrepancy, abscissa_sampling::ulp_uniform})
+    {
+        std::string first = render(sampling, 1, 1);
+        EXPECT_EQ(first, render(sampling, 1, 3));
+        EXPECT_NE(first, render(sampling, 2, 1));
+    }
+
+    // Stratified sampling puts exactly one sample in each stratum:
+    std::vector<double> x(1000);
+    quicksvg::detail::stratified_uniform(x, 0.0, 1.0, 7, 1);
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        ASSERT_GT(x[i], i/1000.0);
+        ASSERT_LE(x[i], (i + 1)/1000.0);
+    }
+
+    // ULP-uniform sampling gives each binade of [2^-10, 2^10) about the same number of samples:
+    std::vector<long double> y(20000);
+    quicksvg::detail::ulp_uniform(y, std::ldexp(1.0f, -10), std::ldexp(1.0f, 10), 7, true);
+    EXPECT_TRUE(std::is_sorted(y.begin(), y.end()));
+    std::vector<int> per_binade(20);
+    for (auto v : y)
+    {
+        per_binade[std::ilogb(v) + 10] += v < std::ldexp(1.0f, 10);
+        // Jittered samples still round to the float they were drawn from:
+        ASSERT_LE(static_cast<float>(v), v);
+    }
+    for (int count : per_binade)
+    {
+        EXPECT_GT(count, 800);
+        EXPECT_LT(count, 1200);
+    }
+
+    // Only IEEE float and double have a bit pattern to sample:
+    auto hi = [](cpp_bin_float_50 x) { return exp(x); };
+    using mp_plot = quicksvg::ulp_plot<decltype(hi), cpp_bin_float_50, long double>;
+    EXPECT_THROW(mp_plot(hi, 1.0L, 2.0L, abscissa_sampling::ulp_uniform, true, 100, 1), std::domain_error);
+}
+
+TEST(ULPPlot, refinement)
+{
+    // An error spike 2^14 ULPs wide peaking at 1000 ULPs; 1000 samples on [1, 2] are ~8000 ULPs apart, so at most one lands on it.
+    float peak = 1.3f;
+    auto lo_acc = [peak](float x)
+    {
+        float y = std::exp(x);
+        float d = std::abs(boost::math::float_distance(x, peak));
+        return d < 16384 ? boost::math::float_advance(y, static_cast<int>(1000*(1 - d/16384))) : y;
+    };
+    auto hi_acc = [](long double x) { return std::exp(x); };
+    quicksvg::ulp_plot<decltype(hi_acc), long double, float> plot(hi_acc, 1.0f, 2.0f, false, 1000, 3);
+    plot.add_fn(lo_acc);
+    float sampled = plot.worst_case().ulp;
+    EXPECT_EQ(plot.worst_case().abscissa, plot.stats().worst_abscissa);
+    EXPECT_LT(sampled, 990);
+
+    plot.set_refinement(5, 500);
+    plot.add_fn(lo_acc);
+    auto worst = plot.worst_case(1);
+    EXPECT_GE(worst.ulp, 998.5f);
+    EXPECT_LE(std::abs(boost::math::float_distance(worst.abscissa, peak)), 16);
+    // The sampled statistics are unaffected:
+    EXPECT_EQ(plot.stats(1).worst, sampled);
+    plot.write("examples/ulp_refinement.svg");
+}
+
+TEST(ULPPlot, stats)
+{
+    auto hi_acc = [](long double x) { return std::exp(x); };
+    quicksvg::ulp_plot<decltype(hi_acc), long double, float> plot(hi_acc, -5.0f, 5.0f, false, 5000);
+    plot.add_fn([](float x) { return std::exp(x); });
+    plot.add_fn([](float x) { return static_cast<float>(std::exp(x)*(1 + 1e-6)); });
+    ASSERT_EQ(plot.function_count(), 2u);
+
+    auto const & exact = plot.stats(0);
+    auto const & biased = plot.stats(1);
+    EXPECT_EQ(exact.count + exact.nan_count, 5000u);
+    size_t total = 0;
+    for (size_t k = 0; k < exact.histogram.size(); ++k)
+    {
+        total += exact.histogram[k];
+    }
+    EXPECT_EQ(total, exact.count);
+    EXPECT_EQ(std::abs(exact.worst), std::max(std::abs(exact.min), std::abs(exact.max)));
+    EXPECT_LE(exact.mean_abs(), std::abs(exact.worst));
+    EXPECT_LE(std::abs(exact.worst), 1.0f);
+    EXPECT_GT(biased.mean(), 2.0);
+    EXPECT_GT(biased.worst, 4.0f);
+}
+
+TEST(ExhaustiveULPPlot, every_float)
+{
+    using boost::multiprecision::exp;
+    auto hi_acc = [](cpp_bin_float_50 x)->cpp_bin_float_50 { return exp(x); };
+    auto lo_acc = [](float x) { return std::exp(x); };
+    float a = 1;
+    float b = 1.001f;
+
+    size_t count = 0;
+    float worst_x = a;
+    float worst_ulp = 0;
+    for (float x = a; x <= b; x = std::nextafter(x, b + 1))
+    {
+        float ulp = quicksvg::detail::ulp_distance<float>(hi_acc(x), cpp_bin_float_50(lo_acc(x)));
+        if (std::abs(ulp) > std::abs(worst_ulp))
+        {
+            worst_ulp = ulp;
+            worst_x = x;
+        }
+        ++count;
+    }
+
+    std::string serial = "examples/exhaustive_exp_serial.svg";
+    std::string parallel = "examples/exhaustive_exp_parallel.svg";
+    {
+        quicksvg::exhaustive_ulp_plot<decltype(hi_acc), cpp_bin_float_50, float> plot(hi_acc, a, b, 1100, 1);
+        EXPECT_EQ(plot.abscissa_count(), count);
+        plot.add_fn(lo_acc);
+        EXPECT_EQ(plot.worst_case().abscissa, worst_x);
+        EXPECT_EQ(plot.worst_case().ulp, worst_ulp);
+        plot.write(serial, true, "Every float in [1, 1.001]");
+    }
+    {
+        quicksvg::exhaustive_ulp_plot<decltype(hi_acc), cpp_bin_float_50, float> plot(hi_acc, a, b, 1100, 3);
+        plot.add_fn(lo_acc);
+        plot.write(parallel, true, "Every float in [1, 1.001]");
+    }
+    EXPECT_EQ(read_file(serial), read_file(parallel));
+    // The title narrows the graph, but there is still at most one column bar per pixel:
+    std::string svg = read_file(serial);
+    std::vector<double> bars;
+    for (std::string tag : {"<line x1='", "<circle cx='"})
+    {
+        for (size_t pos = svg.find(tag); pos != std::string::npos; pos = svg.find(tag, pos + 1))
+        {
+            std::string element = svg.substr(pos, svg.find('>', pos) - pos);
+            if (element.find("steelblue") != std::string::npos)
+            {
+                bars.push_back(std::stod(element.substr(tag.size())));
+            }
+        }
+    }
+    std::sort(bars.begin(), bars.end());
+    ASSERT_GT(bars.size(), 100u);
+    for (size_t i = 1; i < bars.size(); ++i)
+    {
+        ASSERT_LT(std::floor(bars[i - 1]), std::floor(bars[i])) << bars[i];
     }
+    // The margins leave no room for a graph:
+    using plot_type = quicksvg::exhaustive_ulp_plot<decltype(hi_acc), cpp_bin_float_50, float>;
+    EXPECT_THROW(plot_type(hi_acc, a, b, 36), std::domain_error);
 }
 
 TEST(ScatterPlot, types)